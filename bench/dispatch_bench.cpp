@@ -0,0 +1,215 @@
+//
+// Created by John on 19/10/2026.
+//
+// How long dispatching an instruction takes through the generated table (decoder.h), against the
+// nested switch on opcode/funct3/funct7 that CPU::execute used before it.
+// usage: dispatch_bench [rounds]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "decoder.h"
+
+#define BENCH_WORDS (1 << 16) //fits in L2, so it's the decoding that's measured rather than memory
+
+//the old way, written out by hand
+static Op switch_decode(std::uint32_t word) {
+    std::uint32_t funct3 = (word >> 12) & 0x7;
+    std::uint32_t funct7 = word >> 25;
+    switch (word & 0x7f) {
+        case 0x37:
+            return Op::lui;
+        case 0x17:
+            return Op::auipc;
+        case 0x6f:
+            return Op::jal;
+        case 0x67:
+            return funct3 == 0 ? Op::jalr : Op::illegal;
+        case 0x63:
+            switch (funct3) {
+                case 0x0: return Op::beq;
+                case 0x1: return Op::bne;
+                case 0x4: return Op::blt;
+                case 0x5: return Op::bge;
+                case 0x6: return Op::bltu;
+                case 0x7: return Op::bgeu;
+                default: return Op::illegal;
+            }
+        case 0x03:
+            switch (funct3) {
+                case 0x0: return Op::lb;
+                case 0x1: return Op::lh;
+                case 0x2: return Op::lw;
+                case 0x3: return Op::ld;
+                case 0x4: return Op::lbu;
+                case 0x5: return Op::lhu;
+                case 0x6: return Op::lwu;
+                default: return Op::illegal;
+            }
+        case 0x23:
+            switch (funct3) {
+                case 0x0: return Op::sb;
+                case 0x1: return Op::sh;
+                case 0x2: return Op::sw;
+                case 0x3: return Op::sd;
+                default: return Op::illegal;
+            }
+        case 0x13:
+            switch (funct3) {
+                case 0x0: return Op::addi;
+                case 0x1: return funct7 >> 1 == 0x00 ? Op::slli : Op::illegal;
+                case 0x2: return Op::slti;
+                case 0x3: return Op::sltiu;
+                case 0x4: return Op::xori;
+                case 0x5:
+                    switch (funct7 >> 1) {
+                        case 0x00: return Op::srli;
+                        case 0x10: return Op::srai;
+                        default: return Op::illegal;
+                    }
+                case 0x6: return Op::ori;
+                default: return Op::andi;
+            }
+        case 0x33:
+            switch (funct7) {
+                case 0x00:
+                    switch (funct3) {
+                        case 0x0: return Op::add;
+                        case 0x1: return Op::sll;
+                        case 0x2: return Op::slt;
+                        case 0x3: return Op::sltu;
+                        case 0x4: return Op::xor_;
+                        case 0x5: return Op::srl;
+                        case 0x6: return Op::or_;
+                        default: return Op::and_;
+                    }
+                case 0x01:
+                    switch (funct3) {
+                        case 0x0: return Op::mul;
+                        case 0x1: return Op::mulh;
+                        case 0x2: return Op::mulhsu;
+                        case 0x3: return Op::mulhu;
+                        case 0x4: return Op::div;
+                        case 0x5: return Op::divu;
+                        case 0x6: return Op::rem;
+                        default: return Op::remu;
+                    }
+                case 0x20:
+                    return funct3 == 0x0 ? Op::sub : funct3 == 0x5 ? Op::sra : Op::illegal;
+                default:
+                    return Op::illegal;
+            }
+        case 0x1b:
+            switch (funct3) {
+                case 0x0: return Op::addiw;
+                case 0x1: return funct7 == 0x00 ? Op::slliw : Op::illegal;
+                case 0x5: return funct7 == 0x00 ? Op::srliw : funct7 == 0x20 ? Op::sraiw : Op::illegal;
+                default: return Op::illegal;
+            }
+        case 0x3b:
+            switch (funct7) {
+                case 0x00:
+                    switch (funct3) {
+                        case 0x0: return Op::addw;
+                        case 0x1: return Op::sllw;
+                        case 0x5: return Op::srlw;
+                        default: return Op::illegal;
+                    }
+                case 0x01:
+                    switch (funct3) {
+                        case 0x0: return Op::mulw;
+                        case 0x4: return Op::divw;
+                        case 0x5: return Op::divuw;
+                        case 0x6: return Op::remw;
+                        case 0x7: return Op::remuw;
+                        default: return Op::illegal;
+                    }
+                case 0x20:
+                    return funct3 == 0x0 ? Op::subw : funct3 == 0x5 ? Op::sraw : Op::illegal;
+                default:
+                    return Op::illegal;
+            }
+        case 0x0f:
+            return funct3 == 0x0 ? Op::fence : funct3 == 0x1 ? Op::fence_i : Op::illegal;
+        case 0x73:
+            switch (funct3) {
+                case 0x0:
+                    switch (word) {
+                        case 0x00000073: return Op::ecall;
+                        case 0x00100073: return Op::ebreak;
+                        case 0x10200073: return Op::sret;
+                        case 0x30200073: return Op::mret;
+                        case 0x10500073: return Op::wfi;
+                        default: return (word & 0xfe007fff) == 0x12000073 ? Op::sfence_vma : Op::illegal;
+                    }
+                case 0x1: return Op::csrrw;
+                case 0x2: return Op::csrrs;
+                case 0x3: return Op::csrrc;
+                case 0x5: return Op::csrrwi;
+                case 0x6: return Op::csrrsi;
+                case 0x7: return Op::csrrci;
+                default: return Op::illegal;
+            }
+        case 0x2f: {
+            bool d = funct3 == 0x3;
+            if (funct3 != 0x2 && !d)
+                return Op::illegal;
+            switch (funct7 >> 2) {
+                case 0x02: return ((word >> 20) & 0x1f) == 0 ? (d ? Op::lr_d : Op::lr_w) : Op::illegal;
+                case 0x03: return d ? Op::sc_d : Op::sc_w;
+                case 0x01: return d ? Op::amoswap_d : Op::amoswap_w;
+                case 0x00: return d ? Op::amoadd_d : Op::amoadd_w;
+                case 0x04: return d ? Op::amoxor_d : Op::amoxor_w;
+                case 0x0c: return d ? Op::amoand_d : Op::amoand_w;
+                case 0x08: return d ? Op::amoor_d : Op::amoor_w;
+                case 0x10: return d ? Op::amomin_d : Op::amomin_w;
+                case 0x14: return d ? Op::amomax_d : Op::amomax_w;
+                case 0x18: return d ? Op::amominu_d : Op::amominu_w;
+                case 0x1c: return d ? Op::amomaxu_d : Op::amomaxu_w;
+                default: return Op::illegal;
+            }
+        }
+        default:
+            return Op::illegal;
+    }
+}
+
+template<class Decode>
+static double time_ns(const std::vector<std::uint32_t>& words, long rounds, Decode decode, std::uint64_t& sum) {
+    auto start = std::chrono::steady_clock::now();
+    for (long round = 0; round < rounds; round++) {
+        for (auto word : words)
+            sum += (std::uint16_t) decode(word);
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+    return (double) elapsed.count() / ((double) rounds * (double) words.size());
+}
+
+int main(int argc, char** argv) {
+    long rounds = argc > 1 ? std::strtol(argv[1], nullptr, 10) : 1000;
+
+    //every instruction equally often, with random registers and immediates
+    std::mt19937 random(64);
+    std::vector<std::uint32_t> words(BENCH_WORDS);
+    for (auto& word : words) {
+        const Encoding& encoding = ISA[random() % ISA_SIZE];
+        word = encoding.match | (random() & ~encoding.mask);
+    }
+    for (auto word : words) {
+        if (switch_decode(word) != decode_op(word)) {
+            std::printf("Error: the switch decodes %08x differently\n", word);
+            return 1;
+        }
+    }
+
+    std::uint64_t sum = 0;
+    double table = time_ns(words, rounds, decode_op, sum);
+    double nested = time_ns(words, rounds, switch_decode, sum);
+    std::printf("dispatch table: %.2fns per instruction\n", table);
+    std::printf("nested switch:  %.2fns per instruction\n", nested);
+    std::printf("(checksum %lu)\n", sum);
+    return 0;
+}
@@ -0,0 +1,79 @@
+//
+// Created by John on 19/10/2026.
+//
+
+#include <cstdio>
+#include <string>
+
+#include "accel.h"
+
+static const char* routine_names[HostRoutineCount] = {"memcpy", "memmove", "memset", "memcmp", "strlen"};
+
+void Accelerator::bind(const std::vector<Symbol>& symbols) {
+    for (auto& symbol : symbols) {
+        for (int routine = 0; routine < HostRoutineCount; routine++) {
+            if (symbol.name == routine_names[routine])
+                m_entry_points[symbol.addr] = (HostRoutine) routine;
+        }
+    }
+}
+
+//arguments come in a0-a2 and the result goes back in a0, as for the guest function being replaced.
+//every buffer is bounds checked against RAM up front so a bad pointer is left for the guest to fault on
+bool Accelerator::run(HostRoutine routine, std::uint64_t* registers, Bus& bus) {
+    std::uint64_t a0 = registers[10], a1 = registers[11], a2 = registers[12];
+    std::uint8_t* dest;
+    const std::uint8_t *src, *other;
+
+    switch (routine) {
+        case Memcpy:
+        case Memmove:
+            dest = bus.host_pointer(a0, a2);
+            src = bus.readable_pointer(a1, a2);
+            if (dest == nullptr || src == nullptr)
+                return false;
+            std::memmove(dest, src, a2); //guests do call memcpy with overlapping buffers, memmove is just as fast
+            m_bytes_read[routine] += a2;
+            m_bytes_written[routine] += a2;
+            break;
+        case Memset:
+            dest = bus.host_pointer(a0, a2);
+            if (dest == nullptr)
+                return false;
+            std::memset(dest, (int) a1, a2);
+            m_bytes_written[routine] += a2;
+            break;
+        case Memcmp:
+            other = bus.readable_pointer(a0, a2);
+            src = bus.readable_pointer(a1, a2);
+            if (other == nullptr || src == nullptr)
+                return false;
+            registers[10] = (std::int64_t) std::memcmp(other, src, a2);
+            m_bytes_read[routine] += 2 * a2;
+            break;
+        case Strlen: {
+            src = bus.readable_pointer(a0, 1);
+            if (src == nullptr)
+                return false;
+            Memory* region = bus.region(a0, 1);
+            auto end = static_cast<const std::uint8_t*>(std::memchr(src, 0, region->base() + region->size() - a0));
+            if (end == nullptr)
+                return false;
+            registers[10] = end - src;
+            m_bytes_read[routine] += end - src + 1;
+            break;
+        }
+        default:
+            return false;
+    }
+    m_calls[routine]++;
+    return true;
+}
+
+void Accelerator::dump_stats() {
+    for (int routine = 0; routine < HostRoutineCount; routine++) {
+        std::fprintf(stderr, "%-8s calls:%12lu read:%16lu written:%16lu\n", routine_names[routine],
+                     m_calls[routine], m_bytes_read[routine], m_bytes_written[routine]);
+    }
+    std::fprintf(stderr, "fallbacks to guest code:%lu\n", m_fallbacks);
+}
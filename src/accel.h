@@ -0,0 +1,72 @@
+//
+// Created by John on 19/10/2026.
+//
+
+#ifndef CPPRV64_ACCEL_H
+#define CPPRV64_ACCEL_H
+
+#include <cerrno>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "bus.h"
+#include "process.h"
+
+//ecalls with a7 at or above this are host calls rather than Linux syscalls
+#define HOSTCALL_BASE 0x48000
+
+//host implementations of the libc routines guests spend most of their time in,
+//the a7 value for the ecall convention is HOSTCALL_BASE + the routine
+enum HostRoutine {
+    Memcpy,
+    Memmove,
+    Memset,
+    Memcmp,
+    Strlen,
+    HostRoutineCount,
+};
+
+// Replaces byte-at-a-time guest string/memory routines with the host's (vectorised) libc versions,
+// working directly on the guest RAM buffer. Routines are found either by ELF symbol, in which case
+// calls to them are intercepted, or explicitly through an ecall with a7 = HOSTCALL_BASE + routine.
+struct Accelerator {
+private:
+    std::unordered_map<std::uint64_t, HostRoutine> m_entry_points;
+
+    std::uint64_t m_calls[HostRoutineCount]{};
+    std::uint64_t m_bytes_read[HostRoutineCount]{};
+    std::uint64_t m_bytes_written[HostRoutineCount]{};
+    std::uint64_t m_fallbacks{}; //intercepted calls left to the guest because a buffer wasn't entirely in RAM
+
+    bool run(HostRoutine, std::uint64_t* registers, Bus&);
+public:
+    void bind(const std::vector<Symbol>&);
+
+    //called when a jump lands on pc, true if a host routine ran in place of the guest function
+    bool intercept(std::uint64_t pc, std::uint64_t* registers, Bus& bus) {
+        if (m_entry_points.empty())
+            return false;
+        auto it = m_entry_points.find(pc);
+        if (it == m_entry_points.end())
+            return false;
+        if (run(it->second, registers, bus))
+            return true;
+        m_fallbacks++;
+        return false;
+    }
+
+    //services an ecall with a7 >= HOSTCALL_BASE. failures come back in a0 the way syscalls report them,
+    //-ENOSYS if it isn't a routine and -EFAULT if a buffer is out of range
+    void hostcall(std::uint64_t* registers, Bus& bus) {
+        std::uint64_t routine = registers[17] - HOSTCALL_BASE;
+        if (routine >= HostRoutineCount)
+            registers[10] = -ENOSYS;
+        else if (!run((HostRoutine) routine, registers, bus))
+            registers[10] = -EFAULT;
+    }
+
+    void dump_stats();
+};
+
+#endif //CPPRV64_ACCEL_H
@@ -2,25 +2,92 @@
 // Created by John on 15/12/2022.
 //
 
+#include <cstdio>
+
 #include "bus.h"
 
-Bus::Bus(std::uint8_t *data, std::uint64_t len) {
-    m_dram = Memory(data,len);
+Bus::Bus(std::uint8_t *data, std::uint64_t len) : m_dram(data, len) {}
+
+Bus::~Bus() {
+    for (auto file : m_files)
+        delete file;
+    delete m_uart;
+    delete m_io; //flushes whatever the guest wrote
+}
+
+static bool overlaps(std::uint64_t base, std::uint64_t size, std::uint64_t other_base, std::uint64_t other_size) {
+    return base < other_base + other_size && other_base < base + size;
+}
+
+bool Bus::map_file(const std::string& path, std::uint64_t base, bool copy_on_write) {
+    if ((base & 4095) != 0) {
+        std::printf("Error: %s has to be mapped at a page aligned address\n", path.c_str());
+        return false;
+    }
+    Memory* file = Memory::map_file(path, base, copy_on_write);
+    if (file == nullptr)
+        return false;
+    bool clash = base + file->size() < base
+                 || overlaps(base, file->size(), m_dram.base(), m_dram.size())
+                 || overlaps(base, file->size(), UART_BASE, UART_SIZE);
+    for (auto other : m_files)
+        clash = clash || overlaps(base, file->size(), other->base(), other->size());
+    if (clash) {
+        std::printf("Error: %s would overlap RAM, a device or another file at 0x%lx\n", path.c_str(), base);
+        delete file;
+        return false;
+    }
+    m_files.push_back(file);
+    return true;
+}
+
+void Bus::attach_uart(int in_fd, int out_fd) {
+    assert(m_io == nullptr && "Error: The console is already attached");
+    m_io = new IoThread(m_interrupts);
+    m_uart = new Uart(*m_io, m_io->open(in_fd, out_fd, UART_IRQ), m_interrupts);
+    m_io->start();
+}
+
+bool Bus::external_interrupt() {
+    //cleared first, so input that arrives while we look sets it again rather than being missed
+    m_interrupts.exchange(0, std::memory_order_acq_rel);
+    return m_uart != nullptr && m_uart->interrupting();
 }
 
-std::uint64_t Bus::load(std::uint64_t addr, std::uint64_t size) {
-    if (DRAM_BASE <= addr){
-        return m_dram.load(addr, size);
+bool Bus::load(std::uint64_t addr, std::uint64_t size, std::uint64_t& data) {
+    if (m_dram.contains(addr, size / 8)){
+        data = m_dram.load(addr, size);
+        return true;
     }
-    assert(false && "Error: Cannot load address below 0x80000000, MMIO not implemented yet");
-    return -1;
+    for (auto file : m_files) {
+        if (file->contains(addr, size / 8)) {
+            data = file->load(addr, size);
+            return true;
+        }
+    }
+    if (m_uart != nullptr && addr - UART_BASE < UART_SIZE){
+        data = m_uart->load(addr - UART_BASE);
+        return true;
+    }
+    return false;
 }
 
-void Bus::store(std::uint64_t addr, std::uint64_t size, std::uint64_t data) {
-    if (DRAM_BASE <= addr){
+bool Bus::store(std::uint64_t addr, std::uint64_t size, std::uint64_t data) {
+    if (m_dram.contains(addr, size / 8)){
         m_dram.store(addr,size,data);
-        return;
+        return true;
+    }
+    for (auto file : m_files) {
+        if (file->contains(addr, size / 8)) {
+            if (file->writable())
+                file->store(addr, size, data);
+            return true;
+        }
+    }
+    if (m_uart != nullptr && addr - UART_BASE < UART_SIZE){
+        m_uart->store(addr - UART_BASE, data);
+        return true;
     }
-    assert(false && "Error: Cannot write to an address below 0x80000000, MMIO not implemented yet");
+    return false;
 }
 
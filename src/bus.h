@@ -5,18 +5,75 @@
 #ifndef CPPRV64_BUS_H
 #define CPPRV64_BUS_H
 
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "io.h"
 #include "memory.h"
+#include "uart.h"
+
+#define BUS_RECHECK (1u << 31) //bit in the interrupt word that isn't a device, see recheck_interrupts
 
 struct Bus {
 private:
     Memory m_dram;
+    std::vector<Memory*> m_files; //host files mapped into the address space, see map_file
+    IoThread* m_io{}; //only started once a device needs it
+    Uart* m_uart{};
+    std::atomic<std::uint32_t> m_interrupts{}; //a bit per device that may want attention, set from the I/O thread
 public:
     Bus() = default;
     Bus(std::uint8_t*, std::uint64_t);
-    ~Bus() = default;
+    Bus(std::uint64_t base, std::uint64_t size) : m_dram(base, size) {}
+    ~Bus();
+
+    //maps a host file into the guest's physical address space at base, page aligned and clear of RAM and
+    //devices. the guest reads it like RAM. a read only one ignores stores, like a ROM would, a copy on
+    //write one takes them without them ever reaching the file
+    bool map_file(const std::string& path, std::uint64_t base, bool copy_on_write);
+
+    //maps a serial console at UART_BASE, connected to the host file descriptors (-1 for none)
+    void attach_uart(int in_fd, int out_fd);
+    bool has_uart() const { return m_uart != nullptr; }
+    const Uart* uart() const { return m_uart; }
+
+    //cheap enough to check between every block
+    bool interrupt_pending() const { return m_interrupts.load(std::memory_order_relaxed) != 0; }
+    //whether any device's interrupt line is up, clearing the pending word. devices set it again whenever
+    //their line changes, so while the hart has the interrupt masked it isn't looked at every block
+    bool external_interrupt();
+    //has the hart look at the interrupt lines again before its next block, for when it may now take
+    //one it had masked
+    void recheck_interrupts() { m_interrupts.fetch_or(BUS_RECHECK, std::memory_order_relaxed); }
+
+    //false if there's no RAM or device at addr, the hart then raises an access fault
+    bool load(std::uint64_t addr, std::uint64_t size, std::uint64_t& data);
+    bool store(std::uint64_t addr, std::uint64_t size, std::uint64_t data);
+
+    Memory& dram() { return m_dram; }
+
+    //the RAM or mapped file holding all of [addr, addr + len), or nullptr
+    Memory* region(std::uint64_t addr, std::uint64_t len) {
+        if (m_dram.contains(addr, len))
+            return &m_dram;
+        for (auto file : m_files)
+            if (file->contains(addr, len))
+                return file;
+        return nullptr;
+    }
 
-    std::uint64_t load(std::uint64_t, std::uint64_t);
-    void store(std::uint64_t,std::uint64_t,std::uint64_t);
+    //direct access to guest RAM for host code that services the guest (syscalls, bulk copies).
+    //only memory the guest could write itself, read only files are left out
+    std::uint8_t* host_pointer(std::uint64_t addr, std::uint64_t len) {
+        Memory* region = this->region(addr, len);
+        return region != nullptr && region->writable() ? region->host_pointer(addr, len) : nullptr;
+    }
+    //the same for reading, which read only files can be used for as well
+    const std::uint8_t* readable_pointer(std::uint64_t addr, std::uint64_t len) {
+        Memory* region = this->region(addr, len);
+        return region != nullptr ? region->host_pointer(addr, len) : nullptr;
+    }
 };
 
 #endif //CPPRV64_BUS_H
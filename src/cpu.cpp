@@ -1,11 +1,13 @@
 //
 // Created by John on 15/12/2022.
 //
-#define DEBUG false
+
+#include <algorithm>
 
 #include "cpu.h"
+#include "isa.h"
 
-CPU::CPU(uint8_t *binary, uint64_t binary_size) {
+CPU::CPU(uint8_t *binary, uint64_t binary_size) : bus(binary, binary_size) {
     m_pc = DRAM_BASE;
     m_integer_registers = new std::uint64_t[32]();
     csrs = new std::uint64_t[4096]();
@@ -14,16 +16,79 @@ CPU::CPU(uint8_t *binary, uint64_t binary_size) {
 
     mode = Mode::Machine;
 
-    bus = Bus(binary, binary_size);
-
     //setup x2 (sp) with the size of the memory when the cpu is instantiated
     m_integer_registers[2] = DRAM_BASE+MEMORY_SIZE;
 }
 
+CPU::CPU(const std::string& program, const std::vector<std::string>& args, const std::vector<std::string>& env)
+        : bus(USER_MEMORY_BASE, USER_MEMORY_SIZE) {
+    m_integer_registers = new std::uint64_t[32]();
+    csrs = new std::uint64_t[4096]();
+
+    m_floating_point_registers = new std::uint64_t[32]();
+
+    mode = Mode::User;
+
+    m_process = new Process();
+    //a program that fails to load leaves the cpu halted before its first instruction
+    m_halted = !m_process->load(bus, program, args, env, m_pc, m_integer_registers[2]);
+}
+
 CPU::~CPU() {
     delete[] csrs;
     delete[] m_integer_registers;
     delete[] m_floating_point_registers;
+    delete m_process;
+    delete m_accel;
+    delete m_monitor;
+}
+
+void CPU::enable_accelerator() {
+    if (m_accel == nullptr)
+        m_accel = new Accelerator();
+    if (m_process != nullptr)
+        m_accel->bind(m_process->symbols());
+}
+
+Checkpoint CPU::checkpoint() {
+    Checkpoint checkpoint{m_pc, mode, m_reservation, m_halted,
+                          std::vector<std::uint64_t>(m_integer_registers, m_integer_registers + 32),
+                          std::vector<std::uint64_t>(m_floating_point_registers, m_floating_point_registers + 32),
+                          std::vector<std::uint64_t>(csrs, csrs + 4096),
+                          bus.dram().snapshot(), std::nullopt};
+    if (m_process != nullptr)
+        checkpoint.process = *m_process;
+    return checkpoint;
+}
+
+void CPU::restore(const Checkpoint& checkpoint) {
+    assert((checkpoint.process.has_value() == (m_process != nullptr)) && "Error: Checkpoint is from a different kind of CPU");
+    m_pc = checkpoint.pc;
+    mode = (Mode) checkpoint.mode;
+    m_reservation = checkpoint.reservation;
+    m_halted = checkpoint.halted;
+    m_trap_pending = false;
+    std::copy(checkpoint.integer_registers.begin(), checkpoint.integer_registers.end(), m_integer_registers);
+    std::copy(checkpoint.floating_point_registers.begin(), checkpoint.floating_point_registers.end(), m_floating_point_registers);
+    std::copy(checkpoint.csrs.begin(), checkpoint.csrs.end(), csrs);
+    bus.dram().restore(checkpoint.memory);
+    if (m_process != nullptr)
+        *m_process = *checkpoint.process;
+    m_tiers.flush(); //it's all different code now
+}
+
+void CPU::restrict_to_machine_mode() {
+    assert(m_process == nullptr && "Error: User-mode programs need user mode");
+    m_machine_only = true;
+    mode = Mode::Machine;
+    store_csr(MSTATUS, load_csr(MSTATUS));
+}
+
+void CPU::sandbox() {
+    if (m_process != nullptr)
+        m_process->sandbox();
+    else if (!bus.has_uart())
+        bus.attach_uart(-1, -1); //somewhere for console output to go that isn't the real console
 }
 
 void CPU::dump_registers() {
@@ -49,19 +114,94 @@ void CPU::dump_registers() {
     delete[] output;
 }
 
+const std::vector<Symbol>& CPU::symbols() const {
+    static const std::vector<Symbol> none;
+    return m_process != nullptr ? m_process->symbols() : none;
+}
+
+bool CPU::enable_monitor(const std::string& name) {
+    delete m_monitor;
+    m_monitor = new StatsPublisher(name);
+    if (!m_monitor->ok()){
+        delete m_monitor;
+        m_monitor = nullptr;
+        return false;
+    }
+    publish_stats(true);
+    return true;
+}
+
+//copies the counters into the shared segment, at most once a period unless forced
+void CPU::publish_stats(bool force) {
+    if (!m_monitor->due(m_hart_stats.instructions, force))
+        return;
+    constexpr auto relaxed = std::memory_order_relaxed;
+    LiveStats& live = m_monitor->stats();
+    live.instructions.store(m_hart_stats.instructions, relaxed);
+    for (int i = 0; i < 4; i++)
+        live.mode_instructions[i].store(m_hart_stats.mode_instructions[i], relaxed);
+    for (int i = 0; i < STATS_CAUSES; i++){
+        live.exceptions[i].store(m_hart_stats.exceptions[i], relaxed);
+        live.interrupts[i].store(m_hart_stats.interrupts[i], relaxed);
+    }
+    live.cached_blocks.store(m_tiers.stats.cached_blocks, relaxed);
+    live.interpreted_blocks.store(m_tiers.stats.interpreted_blocks, relaxed);
+    live.promotions.store(m_tiers.stats.promotions, relaxed);
+    live.flushes.store(m_tiers.stats.flushes, relaxed);
+    if (bus.has_uart()){
+        live.uart_received.store(bus.uart()->received, relaxed);
+        live.uart_sent.store(bus.uart()->sent, relaxed);
+        live.uart_dropped.store(bus.uart()->dropped, relaxed);
+    }
+    if (m_process != nullptr)
+        live.syscalls.store(m_process->syscalls(), relaxed);
+}
+
+void CPU::dump_stats() {
+    m_tiers.dump_stats();
+    if (m_accel != nullptr)
+        m_accel->dump_stats();
+}
+
 void CPU::dump_csrs() {
     std::printf("mstatus:%18lX mtvec:%18lX mepc:%18lX mcause:%18lX\nsstatus:%18lX stvec:%18lX sepc:%18lX scause:%18lX\n",
                 load_csr(MSTATUS), load_csr(MTVEC), load_csr(MEPC), load_csr(MCAUSE),
                 load_csr(SSTATUS), load_csr(STVEC), load_csr(SEPC), load_csr(SCAUSE));
 }
 
+std::optional<std::uint64_t> CPU::read_register(std::uint64_t reg) {
+    if (reg >= 32)
+        return std::nullopt;
+    return load_integer_register(reg);
+}
+
+bool CPU::write_register(std::uint64_t reg, std::uint64_t data) {
+    if (reg >= 32)
+        return false;
+    store_integer_register(reg, data);
+    return true;
+}
+
+std::optional<std::uint64_t> CPU::read_csr(std::uint64_t addr) {
+    if (addr >= 4096)
+        return std::nullopt;
+    return load_csr(addr);
+}
+
+bool CPU::write_csr(std::uint64_t addr, std::uint64_t value) {
+    if (addr >= 4096)
+        return false;
+    store_csr(addr, value);
+    return true;
+}
+
 uint64_t CPU::load_integer_register(std::uint64_t reg) {
-    assert(reg <= 32 && "attempted to read from an invalid integer register");
+    assert(reg < 32 && "attempted to read from an invalid integer register");
     return m_integer_registers[reg];
 }
 
 void CPU::store_integer_register(std::uint64_t reg, std::uint64_t data) {
-    assert(reg <= 32 && "attempted to write to an invalid integer register");
+    assert(reg < 32 && "attempted to write to an invalid integer register");
     if (reg == 0) //emulate ZERO register
         return;
     m_integer_registers[reg] = data;
@@ -77,522 +217,297 @@ std::uint64_t CPU::load_csr(std::uint64_t addr) {
 void CPU::store_csr(std::uint64_t addr, std::uint64_t value) {
     if (addr == SIE)
         csrs[MIE] = (csrs[MIE] & !csrs[MIDELEG]) | (value & csrs[MIDELEG]);
+    else if (addr == MSTATUS && m_machine_only)
+        csrs[addr] = value | MSTATUS_MPP; //MPP is WARL, and M is the only mode there is to go back to
     else
         csrs[addr] = value;
+    //an interrupt that's pending but was masked may be enabled now
+    if ((csrs[MIP] & MIP_MEIP) != 0) {
+        switch (addr) {
+            case MSTATUS:
+            case SSTATUS:
+            case MIE:
+            case SIE:
+            case MIDELEG:
+            case MTVEC:
+            case STVEC:
+                bus.recheck_interrupts();
+                break;
+            default:
+                break;
+        }
+    }
 }
 
-uint64_t CPU::load(uint64_t addr, uint64_t size) {
-    return bus.load(addr, size);
+bool CPU::fetch(std::uint64_t& instruction) {
+    return bus.load(m_pc, 32, instruction);
 }
 
-void CPU::store(uint64_t addr, uint64_t size, uint64_t data) {
-    bus.store(addr,size,data);
+bool CPU::read_memory(std::uint64_t addr, void* buffer, std::uint64_t len) {
+    auto src = bus.readable_pointer(addr, len);
+    if (src == nullptr)
+        return false;
+    std::memcpy(buffer, src, len);
+    return true;
 }
 
-std::uint64_t CPU::fetch() {
-    return load(m_pc, 32);
+bool CPU::write_memory(std::uint64_t addr, const void* buffer, std::uint64_t len) {
+    auto dest = bus.host_pointer(addr, len);
+    if (dest == nullptr)
+        return false;
+    std::memcpy(dest, buffer, len);
+    m_tiers.flush(); //the write may have been to code
+    return true;
 }
 
-int8_t CPU::cycle() {
-    std::uint64_t current_instruction = fetch();
-    m_pc += 4;
+RunResult CPU::run(std::uint64_t max_instructions) {
+    NoTiming timing;
+    return run(max_instructions, std::chrono::steady_clock::time_point::max(), timing);
+}
 
-    if (execute(current_instruction) != 0){ //return error on unknown instruction
-        return -2;
-    }
-    if (m_pc == 0x0){ //hack to stop infinite loops
-        return -1;
-    }
-    return 0;
+RunResult CPU::run(std::uint64_t max_instructions, CacheTiming& timing) {
+    return run(max_instructions, std::chrono::steady_clock::time_point::max(), timing);
 }
 
-void CPU::loop() {
-    while (cycle() == 0){
-#if DEBUG
-        dump_registers();
-        dump_csrs();
-#endif
-    }
+RunResult CPU::run(std::uint64_t max_instructions, BbvProfile& profile) {
+    return run(max_instructions, std::chrono::steady_clock::time_point::max(), profile);
 }
 
-uint8_t CPU::execute(std::uint64_t instruction) {
-    std::uint64_t opcode = instruction & 0x7f;
-    std::uint64_t rd = (instruction >> 7) & 0x1f;
-    std::uint64_t rs1 = (instruction >> 15) & 0x1f;
-    std::uint64_t rs2 = (instruction >> 20) & 0x1f;
-    std::uint64_t funct3 = (instruction >> 12) & 0x7;
-    std::uint64_t funct7 = (instruction >> 25) & 0x7f;
-
-    std::uint64_t imm, addr, shamt, temp, funct5, csr_addr; // acquire, release will be needed for proper atomics
-
-//    printf("Instruction %08lX : ", instruction);
-    switch (opcode) {
-        case 0x03: //Load Instructions
-            imm = (int64_t)((int32_t) (instruction & 0xfff00000)) >> 20;
-            addr = load_integer_register(rs1) + imm;
-            switch (funct3) {
-                case 0x0: //lb
-//                    std::printf("lb: rd=x%02ld imm=0x%08lX (%ld) addr=0x%08ld\n", rd, imm, imm, addr);
-                    store_integer_register(rd, ((int64_t) ((int8_t) load(addr, 8))));
-                    break;
-                case 0x1: //lh
-//                    std::printf("lh: rd=x%02ld imm=0x%08lX (%ld) addr=0x%08ld\n", rd, imm, imm, addr);
-                    store_integer_register(rd, ((int64_t) ((int16_t) load(addr, 16))));
-                    break;
-                case 0x2: //lw
-//                    std::printf("lw: rd=x%02ld imm=0x%08lX (%ld) addr=0x%08ld\n", rd, imm, imm, addr);
-                    store_integer_register(rd, ((int64_t) ((int32_t) load(addr, 32))));
-                    break;
-                case 0x3: //ld
-//                    std::printf("ld: rd=x%02ld imm=0x%08lX (%ld) addr=0x%08ld\n", rd, imm, imm, addr);
-                    store_integer_register(rd, load(addr, 64));
-                    break;
-                case 0x4: //lbu
-//                    std::printf("lbu: rd=x%02ld imm=0x%08lX (%ld) addr=0x%08ld\n", rd, imm, imm, addr);
-                    store_integer_register(rd, load(addr, 8));
-                    break;
-                case 0x5: //lhu
-//                    std::printf("lhu: rd=x%02ld imm=0x%08lX (%ld) addr=0x%08ld\n", rd, imm, imm, addr);
-                    store_integer_register(rd, load(addr, 16));
-                    break;
-                case 0x6: //lwu
-//                    std::printf("lwu: rd=x%02ld imm=0x%08lX (%ld) addr=0x%08ld\n", rd, imm, imm, addr);
-                    store_integer_register(rd, load(addr, 32));
-                    break;
-                default:
-                    std::printf("ERROR : Invalid Load : funct3=%lX\n", funct3);
-                    return -1;
-            }
+RunResult CPU::run_until(std::uint64_t pc, std::uint64_t max_instructions) {
+    //a temporary breakpoint, unless there's a real one there already
+    bool temporary = m_breakpoints.insert(pc).second;
+    RunResult result = run(max_instructions);
+    if (temporary)
+        m_breakpoints.erase(pc);
+    return result;
+}
+
+RunResult CPU::run_until(std::chrono::steady_clock::time_point deadline, std::uint64_t max_instructions) {
+    NoTiming timing;
+    return run(max_instructions, deadline, timing);
+}
+
+//what the hart is using at the moment, see engine_config.h
+unsigned CPU::features() const {
+    return (m_tracing ? FEATURE_TRACING : 0) | (m_machine_only ? 0 : FEATURE_PRIVILEGE)
+           | (m_monitor != nullptr ? FEATURE_COUNTERS : 0) | (bus.has_uart() ? FEATURE_INTERRUPTS : 0)
+           | (m_accel != nullptr ? FEATURE_ACCELERATOR : 0);
+}
+
+//picks the most specialised build of the engine that covers everything in use. features only change
+//between runs, so the choice holds for the whole run
+template<class Timing>
+RunResult CPU::run(std::uint64_t max_instructions, std::chrono::steady_clock::time_point deadline, Timing& timing) {
+    unsigned features = this->features();
+    if ((features & ~CONFIG_MACHINE_ONLY) == 0)
+        return run_configured<EngineConfig<Timing, CONFIG_MACHINE_ONLY>>(max_instructions, deadline, timing);
+    if ((features & ~CONFIG_USER_PROGRAM) == 0)
+        return run_configured<EngineConfig<Timing, CONFIG_USER_PROGRAM>>(max_instructions, deadline, timing);
+    return run_configured<EngineConfig<Timing, CONFIG_EVERYTHING>>(max_instructions, deadline, timing);
+}
+
+template<class Config>
+RunResult CPU::run_configured(std::uint64_t max_instructions, std::chrono::steady_clock::time_point deadline,
+                              typename Config::Timing& timing) {
+    RunResult result{StopReason::BudgetExhausted, m_pc, 0, 0};
+    bool check_deadline = deadline != std::chrono::steady_clock::time_point::max();
+    std::uint64_t blocks = 0;
+
+    while (result.instructions < max_instructions){
+        if (m_halted || m_pc == 0x0){ //hack to stop infinite loops
+            result.reason = StopReason::Halted;
             break;
-        case 0x13:
-            imm = (int64_t)((int32_t) (instruction & 0xfff00000)) >> 20;
-            shamt = (std::uint32_t) (imm & 0x3f);
-
-            switch (funct3) {
-                case 0x0: //addi
-//                    std::printf("addi: rd=x%02ld imm=0x%08lX (%ld) rs1=x%02ld\n", rd, imm, imm, rs1);
-                    store_integer_register(rd, load_integer_register(rs1) + imm);
-                    break;
-                case 0x1: //slli
-//                    std::printf("slli: rd=x%02ld shamt=0x%08lX (%ld) rs1=x%02ld\n", rd, shamt, shamt, rs1);
-                    store_integer_register(rd, load_integer_register(rs1) << shamt);
-                    break;
-                case 0x2: //slti
-//                    std::printf("slti: rd=x%02ld imm=0x%08lX (%ld) rs1=x%02ld\n", rd, imm, imm, rs1);
-                    store_integer_register(rd, (int64_t) load_integer_register(rs1) < (int64_t) imm ? 1 : 0);
-                    break;
-                case 0x3: //sltiu
-//                    std::printf("sltiu: rd=x%02ld imm=0x%08lX (%ld) rs1=x%02ld\n", rd, imm, imm, rs1);
-                    store_integer_register(rd, load_integer_register(rs1) < imm ? 1 : 0);
-                    break;
-                case 0x4: //xori
-//                    std::printf("xori: rd=x%02ld imm=0x%08lX (%ld) rs1=x%02ld\n", rd, imm, imm, rs1);
-                    store_integer_register(rd, load_integer_register(rs1) ^ imm);
-                    break;
-                case 0x5: //rotate
-                    switch (funct7 >> 1) {
-                        case 0x00: //srli
-//                            std::printf("srli: rd=x%02ld shamt=0x%08lX (%ld) rs1=x%02ld\n", rd, shamt, shamt, rs1);
-                            store_integer_register(rd, (load_integer_register(rs1) >> shamt)
-                                                       | (load_integer_register(rs1) << (64 - shamt)));
-                            break;
-                        case 0x10: //srai
-//                            std::printf("srai: rd=x%02ld shamt=0x%08lX (%ld) rs1=x%02ld\n", rd, shamt, shamt, rs1);
-                            store_integer_register(rd, ((int64_t) load_integer_register(rs1) >> shamt)
-                                                       | ((int64_t) load_integer_register(rs1) << (64 - shamt)));
-                            break;
-                        default:
-                            std::printf("ERROR : Rotate Not Implemented Yet : funct7=%lX\n", funct7);
-                            return -1;
-                    }
-                    break;
-                case 0x6: //ori
-//                    std::printf("ori: rd=x%02ld imm=0x%08lX (%ld) rs1=x%02ld\n", rd, imm, imm, rs1);
-                    store_integer_register(rd, load_integer_register(rs1) | imm);
-                    break;
-                case 0x7: //andi
-//                    std::printf("andi: rd=x%02ld imm=0x%08lX (%ld) rs1=x%02ld\n", rd, imm, imm, rs1);
-                    store_integer_register(rd, load_integer_register(rs1) & imm);
-                    break;
-                default:
-                    std::printf("ERROR : Not Implemented Yet : funct3=%lX\n", funct3);
-                    return -1;
+        }
+        if constexpr (Config::interrupts){
+            if (bus.interrupt_pending()){
+                take_interrupt();
             }
-            break;
-        case 0x17: //auipc
-            imm = (int64_t) ((int32_t) (instruction & 0xFFFFF000));
-//            std::printf("auipc: rd=x%02ld imm=0x%08lX (%ld)\n", rd, imm, imm);
-            store_integer_register(rd, m_pc + imm - 4);
-            break;
-        case 0x1b:
-            imm = (int64_t) ((int32_t) instruction) >> 20;
-            shamt = (uint32_t) (imm & 0x1f);
-            switch (funct3) {
-                case 0x0: //addiw
-//                    std::printf("addiw: rd=x%02ld imm=0x%08lX (%ld) rs1=x%02ld\n", rd, imm, imm, rs1);
-                    store_integer_register(rd, (int64_t) ((int32_t) (load_integer_register(rs1) + imm)));
-                    break;
-                case 0x1: //slliw
-//                    std::printf("slliw: rd=x%02ld shamt=0x%08lX (%ld) rs1=x%02ld\n", rd, shamt, shamt, rs1);
-                    store_integer_register(rd, (int64_t) ((int32_t) (((uint32_t) load_integer_register(rs1) << shamt)
-                                                                     | ((uint32_t) load_integer_register(rs1)
-                            >> (32 - shamt)))));
-                    break;
-                case 0x5:
-                    switch (funct7) {
-                        case 0x00: //srliw
-//                            std::printf("srliw: rd=x%02ld shamt=0x%08lX (%ld) rs1=x%02ld\n", rd, shamt, shamt, rs1);
-                            store_integer_register(rd, (int64_t) ((int32_t) (
-                                    ((uint32_t) load_integer_register(rs1) >> shamt)
-                                    | ((uint32_t) load_integer_register(rs1) << (32 - shamt)))));
-                            break;
-                        case 0x20: //sraiw
-//                            std::printf("sraiw: rd=x%02ld shamt=0x%08lX (%ld) rs1=x%02ld\n", rd, shamt, shamt, rs1);
-                            store_integer_register(rd,
-                                                   (int64_t) ((int32_t) (((int32_t) load_integer_register(rs1) >> shamt)
-                                                                         | ((int32_t) load_integer_register(rs1)
-                                                           << (32 - shamt)))));
-                            break;
-                        default:
-                            std::printf("ERROR : Not Implemented Yet : funct7=%lX\n", funct7);
-                            return -1;
-                    }
-                    break;
-                default:
-                    std::printf("ERROR : Not Implemented Yet : funct3=%lX\n", funct3);
-                    return -1;
+        }
+        //blocks are cut short at the next breakpoint so that it's always the start of a block
+        std::uint64_t limit = max_instructions - result.instructions;
+        if (!m_breakpoints.empty()){
+            if (blocks != 0 && m_breakpoints.count(m_pc)){
+                result.reason = StopReason::Breakpoint;
+                break;
             }
+            auto next = m_breakpoints.upper_bound(m_pc);
+            if (next != m_breakpoints.end())
+                limit = std::min(limit, std::max<std::uint64_t>((*next - m_pc) / 4, 1));
+        }
+        //the clock is only read every so often so deadlines stay cheap
+        if (check_deadline && (blocks & 0x3ff) == 0 && std::chrono::steady_clock::now() >= deadline){
+            result.reason = StopReason::Deadline;
             break;
-        case 0x23: //Store Instructions
-            imm = ((uint64_t)((int64_t)((int32_t)(instruction & 0xFE000000)) >> 20)) | ((instruction >> 7) & 0x1F);
-            addr = (load_integer_register(rs1) + imm) % 0xFFFFFFFF;
-            switch (funct3) {
-                case 0x0: //sb
-//                    std::printf("sb: rs2=x%02ld addr=0x%08ld\n", rs2, addr);
-                    store(addr, 8, load_integer_register(rs2));
-                    break;
-                case 0x1: //sh
-//                    std::printf("sh: rs2=x%02ld addr=0x%08ld\n", rs2, addr);
-                    store(addr, 16, load_integer_register(rs2));
-                    break;
-                case 0x2: //sw
-//                    std::printf("sw: rs2=x%02ld addr=0x%08ld\n", rs2, addr);
-                    store(addr, 32, load_integer_register(rs2));
-                    break;
-                case 0x3: //sd
-//                    std::printf("sd: rs2=x%02ld addr=0x%08ld\n", rs2, addr);
-                    store(addr, 64, load_integer_register(rs2));
-                    break;
-                default:
-                    std::printf("ERROR : Invalid Store : funct3=%lX\n", funct3);
-                    return -1;
+        }
+        if constexpr (Config::tracing){
+            if (m_tracing){
+                limit = 1;
             }
-            break;
-        case 0x2f: //RV64A : Atomic instructions
-            funct5 = (funct7 & 0b11111100) >> 2;
-            //acquire = (funct7 & 0b00000010) >> 1; //acquire access
-            //release = funct7 & 0b00000001; //release access
-            switch (funct3) {
-                case 0x2:
-                    switch (funct5) {
-                        case 0x00: //amoadd.w
-                            temp = load(load_integer_register(rs1), 32);
-                            store(load_integer_register(rs1), 32, load_integer_register(rs2) + temp);
-                            store_integer_register(rd, temp);
-                            break;
-                        case 0x01: //amoswap.w
-                            temp = load(load_integer_register(rs1), 32);
-                            store(load_integer_register(rs1), 32, load_integer_register(rs2));
-                            store_integer_register(rd, temp);
-                            break;
-                        default:
-                            std::printf("ERROR : Not Implemented Yet : funct5=%lX\n", funct5);
-                            return -1;
-                    }
-                    break;
-                case 0x3:
-                    switch (funct5) {
-                        case 0x00: //amoadd.d
-                            temp = load(load_integer_register(rs1), 64);
-                            store(load_integer_register(rs1), 32, load_integer_register(rs2) + temp);
-                            store_integer_register(rd, temp);
-                            break;
-                        case 0x01: //amoswap.d
-                            temp = load(load_integer_register(rs1), 64);
-                            store(load_integer_register(rs1), 32, load_integer_register(rs2));
-                            store_integer_register(rd, temp);
-                            break;
-                        default:
-                            std::printf("ERROR : Not Implemented Yet : funct5=%lX\n", funct5);
-                            return -1;
-                    }
-                    break;
-                default:
-                    std::printf("ERROR : Not Implemented Yet : funct3=%lX\n", funct3);
-                    return -1;
+        }
+        std::uint64_t executed = 0;
+        Mode block_mode = mode;
+        int8_t status = run_block<Config>(limit, executed, timing);
+        result.instructions += executed;
+        blocks++;
+        if constexpr (Config::counters){
+            m_hart_stats.instructions += executed;
+            m_hart_stats.mode_instructions[block_mode] += executed;
+            if (m_monitor != nullptr && (blocks & 0x3ff) == 0){
+                publish_stats(false);
             }
-            break;
-        case 0x33:
-            shamt = (uint32_t) (load_integer_register(rs2) & 0x3f);
-            switch (funct3) {
-                case 0x0:
-                    switch (funct7) {
-                        case 0x00: //add
-//                            std::printf("add: rd=x%02ld rs1=x%02ld rs2=x%02ld\n", rd, rs1, rs2);
-                            store_integer_register(rd, load_integer_register(rs1) + load_integer_register(rs2));
-                            break;
-                        case 0x01: //mul
-//                            std::printf("mul: rd=x%02ld rs1=x%02ld rs2=x%02ld\n", rd, rs1, rs2);
-                            store_integer_register(rd, load_integer_register(rs1) * load_integer_register(rs2));
-                            break;
-                        case 0x20: //sub
-//                            std::printf("sub: rd=x%02ld rs1=x%02ld rs2=x%02ld\n", rd, rs1, rs2);
-                            store_integer_register(rd, load_integer_register(rs1) - load_integer_register(rs2));
-                            break;
-                        default:
-                            std::printf("ERROR : Not Implemented Yet : funct7=%lX\n", funct7);
-                            return -1;
-                    }
-                    break;
-                case 0x1: //sll
-//                    std::printf("sll: rd=x%02ld shamt=0x%08lX (%ld) rs1=x%02ld\n", rd, shamt, shamt, rs1);
-                    store_integer_register(rd, (load_integer_register(rs1) << shamt)
-                                               | (load_integer_register(rs1) >> (64 - shamt)));
-                    break;
-                case 0x2: //slt
-//                    std::printf("slt: rd=x%02ld rs2=x%02ld rs1=x%02ld\n", rd, rs2, rs1);
-                    store_integer_register(rd,
-                                           (int64_t) load_integer_register(rs1) < (int64_t) load_integer_register(rs2)
-                                           ? 1 : 0);
-                    break;
-                case 0x3: //sltu
-//                    std::printf("sltu: rd=x%02ld rs2=x%02ld rs1=x%02ld\n", rd, rs2, rs1);
-                    store_integer_register(rd, load_integer_register(rs1) < load_integer_register(rs2) ? 1 : 0);
-                    break;
-                case 0x4: //xor
-//                    std::printf("xor: rd=x%02ld rs2=x%02ld rs1=x%02ld\n", rd, rs2, rs1);
-                    store_integer_register(rd, load_integer_register(rs1) ^ load_integer_register(rs2));
-                    break;
-                case 0x5: //rotate
-                    switch (funct7) {
-                        case 0x00: //srl
-//                            std::printf("srl: rd=x%02ld shamt=0x%08lX (%ld) rs1=x%02ld\n", rd, shamt, shamt, rs1);
-                            store_integer_register(rd, (load_integer_register(rs1) >> shamt)
-                                                       | (load_integer_register(rs1) << (64 - shamt)));
-                            break;
-                        case 0x20: //sra
-//                            std::printf("sra: rd=x%02ld shamt=0x%08lX (%ld) rs1=x%02ld\n", rd, shamt, shamt, rs1);
-                            store_integer_register(rd, ((int64_t) load_integer_register(rs1) >> shamt)
-                                                       | ((int64_t) load_integer_register(rs1) << (64 - shamt)));
-                            break;
-                        default:
-                            std::printf("ERROR : Rotate Not Implemented Yet : funct7=%lX\n", funct7);
-                            return -1;
-                    }
-                    break;
-                case 0x6: //or
-//                    std::printf("or: rd=x%02ld rs2=x%02ld rs1=x%02ld\n", rd, rs2, rs1);
-                    store_integer_register(rd, load_integer_register(rs1) | load_integer_register(rs2));
-                    break;
-                case 0x7: //and
-//                    std::printf("and: rd=x%02ld rs2=x%02ld rs1=x%02ld\n", rd, rs2, rs1);
-                    store_integer_register(rd, load_integer_register(rs1) & load_integer_register(rs2));
-                    break;
-                default:
-                    std::printf("ERROR : Not Implemented Yet : funct3=%lX\n", funct3);
-                    return -1;
+        }
+        if constexpr (Config::tracing){
+            if (m_tracing){
+                dump_registers();
+                dump_csrs();
             }
+        }
+        if (status != 0){
+            result.reason = m_trap_cause == CAUSE_ILLEGAL_INSTRUCTION ? StopReason::IllegalInstruction : StopReason::Trap;
+            result.cause = m_trap_cause;
+            m_trap_pending = false;
             break;
-        case 0x37: //lui
-            imm = (int64_t) ((int32_t) (instruction & 0xFFFFF000));
-//            std::printf("lui: rd=x%02ld imm=0x%08lX (%ld)\n", rd, imm, imm);
-            store_integer_register(rd, imm);
-            break;
-        case 0x3b:
-            shamt = (uint32_t) (load_integer_register(rs2) & 0x1f);
-            switch (funct3) {
-                case 0x0:
-                    switch (funct7) {
-                        case 0x00: //addw
-//                            std::printf("addw: rd=x%02ld rs1=x%02ld rs2=x%02ld\n", rd, rs1, rs2);
-                            store_integer_register(rd, (int64_t) ((int32_t) (load_integer_register(rs1) +
-                                                                             load_integer_register(rs2))));
-                            break;
-                        case 0x20: //subw
-//                            std::printf("sub: rd=x%02ld rs1=x%02ld rs2=x%02ld\n", rd, rs1, rs2);
-                            store_integer_register(rd, (int64_t) ((int32_t) (load_integer_register(rs1) -
-                                                                             load_integer_register(rs2))));
-                            break;
-                        default:
-                            std::printf("ERROR : Not Implemented Yet : funct7=%lX\n", funct7);
-                            return -1;
-                    }
-                    break;
-                case 0x1: //sllw
-//                    std::printf("sllw: rd=x%02ld shamt=0x%08lX (%ld) rs1=x%02ld\n", rd, shamt, shamt, rs1);
-                    store_integer_register(rd, (int32_t) (((uint32_t) load_integer_register(rs1) << shamt)
-                                                          | ((uint32_t) load_integer_register(rs1) >> (32 - shamt))));
-                    break;
-                case 0x5:
-                    switch (funct7) {
-                        case 0x00: //srlw
-//                            std::printf("srlw: rd=x%02ld shamt=0x%08lX (%ld) rs1=x%02ld\n", rd, shamt, shamt, rs1);
-                            store_integer_register(rd, (int32_t) (((uint32_t) load_integer_register(rs1) >> shamt)
-                                                                  | ((uint32_t) load_integer_register(rs1)
-                                    << (32 - shamt))));
-                            break;
-                        case 0x20: //sraw
-//                            std::printf("sraw: rd=x%02ld shamt=0x%08lX (%ld) rs1=x%02ld\n", rd, shamt, shamt, rs1);
-                            store_integer_register(rd, ((int32_t) load_integer_register(rs1) >> (int32_t) shamt)
-                                                       |
-                                                       ((int32_t) load_integer_register(rs1) << (32 - (int32_t) shamt)));
-                            break;
-                        default:
-                            std::printf("ERROR : Not Implemented Yet : funct7=%lX\n", funct7);
-                            return -1;
-                    }
-                    break;
-                default:
-                    std::printf("ERROR : Not Implemented Yet : funct3=%lX\n", funct3);
-                    return -1;
+        }
+    }
+    result.pc = m_pc;
+    if constexpr (Config::counters){
+        if (m_monitor != nullptr){
+            publish_stats(true);
+        }
+    }
+    return result;
+}
+
+//runs up to limit instructions of one block, from the block cache if it's been promoted, otherwise an
+//instruction at a time. executed is set to the instructions retired, non-zero means an unhandled trap
+template<class Config>
+int8_t CPU::run_block(std::uint64_t limit, std::uint64_t& executed, typename Config::Timing& timing) {
+    Block* block = m_tiers.next(m_pc);
+    if (block == nullptr && m_tiers.count(m_pc)){
+        block = m_tiers.promote(m_pc, bus);
+    }
+
+    executed = 0;
+    if (block != nullptr){
+        std::uint64_t count = std::min<std::uint64_t>(block->instructions.size(), limit);
+        for (; executed < count; executed++){
+            const Decoded& decoded = block->instructions[executed];
+            timing.fetch(m_pc);
+            m_pc += 4;
+            if (!HANDLERS<Config>[(std::uint16_t) decoded.op](*this, decoded, timing)){
+                return fault(decoded.word);
             }
-            break;
-        case 0x63:
-            imm = (uint64_t)((int64_t)((int32_t)(instruction & 0x80000000)) >> 19)
-                    | ((instruction & 0x80) << 4)
-                    | ((instruction >> 20) & 0x7e0)
-                    | ((instruction >> 7) & 0x1e);
-            switch (funct3) {
-                case 0x0: //beq
-//                    std::printf("beq: imm=0x%08lX (%ld) rs2=x%02ld rs1=x%02ld\n", imm, imm, rs2, rs1);
-                    if (load_integer_register(rs1) == load_integer_register(rs2)){
-                        m_pc += imm - 4;
-                    }
-                    break;
-                case 0x1: //bne
-//                    std::printf("bne: imm=0x%08lX (%ld) rs2=x%02ld rs1=x%02ld\n", imm, imm, rs2, rs1);
-                    if (load_integer_register(rs1) != load_integer_register(rs2)){
-                        m_pc += imm - 4;
-                    }
-                    break;
-                case 0x4: //blt
-//                    std::printf("blt: imm=0x%08lX (%ld) rs2=x%02ld rs1=x%02ld\n", imm, imm, rs2, rs1);
-                    if ((int64_t) load_integer_register(rs1) < (int64_t) load_integer_register(rs2)){
-                        m_pc += imm - 4;
-                    }
-                    break;
-                case 0x5: //bge
-//                    std::printf("bge: imm=0x%08lX (%ld) rs2=x%02ld rs1=x%02ld\n", imm, imm, rs2, rs1);
-                    if ((int64_t) load_integer_register(rs1) >= (int64_t) load_integer_register(rs2)){
-                        m_pc += imm - 4;
-                    }
-                    break;
-                case 0x6: //bltu
-//                    std::printf("bltu: imm=0x%08lX (%ld) rs2=x%02ld rs1=x%02ld\n", imm, imm, rs2, rs1);
-                    if (load_integer_register(rs1) < load_integer_register(rs2)){
-                        m_pc += imm - 4;
-                    }
-                    break;
-                case 0x7: //bgeu
-//                    std::printf("bgeu: imm=0x%08lX (%ld) rs2=x%02ld rs1=x%02ld\n", imm, imm, rs2, rs1);
-                    if (load_integer_register(rs1) >= load_integer_register(rs2)){
-                        m_pc += imm - 4;
-                    }
-                    break;
-                default:
-                    std::printf("ERROR : Not Implemented Yet : funct3=%lX\n", funct3);
-                    return -1;
+        }
+        m_tiers.stats.cached_blocks++;
+        m_tiers.stats.cached_instructions += count;
+        if (count == block->instructions.size()){
+            m_tiers.jumped(block->instructions[count - 1], block->pc + 4 * (count - 1), m_pc, block);
+        }
+    } else {
+        limit = std::min<std::uint64_t>(limit, MAX_BLOCK_LENGTH);
+        std::uint64_t instruction, pc;
+        do {
+            pc = m_pc;
+            if (!fetch(instruction)){
+                return trap(pc, CAUSE_INSTRUCTION_ACCESS_FAULT, pc) ? 0 : -1;
             }
-            break;
-        case 0x67: //jalr
-            temp = m_pc;
-            imm = (int64_t)((int32_t)(instruction & 0xFFF00000)) >> 20;
-//            std::printf("jalr: rd=x%02ld imm=0x%08lX (%ld) rs1=x%02ld\n", rd, imm, imm, rs1);
-            m_pc = (load_integer_register(rs1) + imm) & 0xFFFFFFFE;
-            store_integer_register(rd, temp);
-            break;
-        case 0x6f: //jal
-            store_integer_register(rd, m_pc);
-            imm = (uint64_t)((int64_t)((int32_t)(instruction & 0x80000000)) >> 11)
-                  | (instruction & 0xFF000)
-                  | ((instruction >> 9) & 0x800)
-                  | ((instruction >> 20) & 0x7FE);
-//            std::printf("jal: imm=0x%08lX (%ld)\n", imm, imm);
-            m_pc += imm - 4;
-            break;
-        case 0x73:
-            csr_addr = (instruction & 0xfff00000) >> 20; //csr address
-            switch (funct3) {
-                case 0x0:
-                    if (funct7 == 0x9){ //sfence.vma
-                        // do nothing
-                    } else if (rs2 == 0x2) {
-                        if (funct7 == 0x8) { //sret
-                            m_pc = load_csr(SEPC);
-                            mode = ((load_csr(SSTATUS) >> 8) & 1) == 1 ? Mode::Supervisor : Mode::User;
-                            store_csr(SSTATUS, ((load_csr(SSTATUS) >> 5) & 1) == 1 ? load_csr(SSTATUS) | 2 : load_csr(SSTATUS) & 0xFFFFFFFFFFFFFFFD);
-                            store_csr(SSTATUS, load_csr(SSTATUS) | 32);
-                            store_csr(SSTATUS, load_csr(SSTATUS) & 0xFFFFFFFFFFFFFEFF);
-                        } else if (funct7 == 0x18) { //mret
-                            m_pc = load_csr(MEPC);
-                            switch ((load_csr(MSTATUS)>>11) & 0b11) {
-                                case 2:
-                                    mode = Mode::Machine;
-                                    break;
-                                case 1:
-                                    mode = Mode::Supervisor;
-                                    break;
-                                default:
-                                    mode = Mode::User;
-                                    break;
-                            }
-                            store_csr(MSTATUS, ((load_csr(MSTATUS) >> 7) &  1) == 1 ? load_csr(MSTATUS) | 8 : load_csr(MSTATUS) & 0xFFFFFFFFFFFFFFF7);
-                        }
-                    } else {
-                        std::printf("ERROR: Instruction with opcode %04lX : Not Implemented\n", opcode);
-                        return -1;
-                    }
-                    break;
-                case 0x1: //csrrw
-                    temp = load_csr(csr_addr);
-                    store_csr(csr_addr, load_integer_register(rs1));
-                    store_integer_register(rd, temp);
-                    break;
-                case 0x2: //csrrs
-                    temp = load_csr(csr_addr);
-                    store_csr(csr_addr, temp | load_integer_register(rs1));
-                    store_integer_register(rd, temp);
-                    break;
-                case 0x3: //csrrc
-                    temp = load_csr(csr_addr);
-                    store_csr(csr_addr, temp & (0xFFFFFFFFFFFFFFFF ^ load_integer_register(rs1))); //NOTE: maybe wrong?
-                    store_integer_register(rd, temp);
-                    break;
-                case 0x5: //csrrwi
-                    store_integer_register(rd, load_csr(csr_addr));
-                    store_csr(csr_addr, rs1);
-                    break;
-                case 0x6: //csrrsi
-                    temp = load_csr(csr_addr);
-                    store_csr(csr_addr, temp | rs1);
-                    store_integer_register(rd, temp);
-                    break;
-                case 0x7: //csrrci
-                    temp = load_csr(csr_addr);
-                    store_csr(csr_addr, temp & (0xFFFFFFFFFFFFFFFF ^ rs1));
-                    store_integer_register(rd, temp);
-                    break;
-                default:
-                    std::printf("ERROR: Instruction with opcode %04lX : Not Implemented\n", opcode);
-                    return -1;
+            timing.fetch(m_pc);
+            m_pc += 4;
+            if (execute<Config>(instruction, timing) != 0){
+                return fault(instruction);
             }
-            break;
-        default:
-            std::printf("ERROR: Instruction with opcode %04lX : Not Implemented\n", opcode);
-            return -1;
+            executed++;
+        } while (executed < limit && !TierManager::ends_block(instruction));
+        m_tiers.stats.interpreted_blocks++;
+        m_tiers.stats.interpreted_instructions += executed;
+        if (TierManager::ends_block(instruction)){
+            m_tiers.jumped(decode(instruction), pc, m_pc, nullptr);
+        }
     }
+    m_tiers.flush_if_invalidated();
     return 0;
 }
 
+//an instruction just failed to execute, either it trapped with no handler or it was illegal
+int8_t CPU::fault(std::uint64_t instruction) {
+    if (m_trap_taken){ //it already trapped, see exception
+        m_trap_taken = false;
+        return 0;
+    }
+    if (!m_trap_pending && trap(m_pc - 4, CAUSE_ILLEGAL_INSTRUCTION, instruction)){
+        return 0;
+    }
+    return -1;
+}
+
+//raised by an instruction handler for an exception that has to stop the block it's in,
+//returns false so that it does. the handler is in the middle of the instruction, pc is past it
+bool CPU::exception(std::uint64_t cause, std::uint64_t tval) {
+    m_trap_taken = trap(m_pc - 4, cause, tval);
+    return false;
+}
+
+//takes an exception at epc, to the supervisor if it's delegated there otherwise to machine mode.
+//returns false if there's no handler installed to take it, the trap is then left pending for run to report
+bool CPU::trap(std::uint64_t epc, std::uint64_t cause, std::uint64_t tval) {
+    bool interrupt = (cause & CAUSE_INTERRUPT) != 0;
+    std::uint64_t code = cause & ~CAUSE_INTERRUPT;
+    (interrupt ? m_hart_stats.interrupts : m_hart_stats.exceptions)[code < STATS_CAUSES ? code : STATS_CAUSES - 1]++;
+    bool delegated = mode != Mode::Machine && ((load_csr(interrupt ? MIDELEG : MEDELEG) >> code) & 1) == 1;
+    std::uint64_t tvec = load_csr(delegated ? STVEC : MTVEC);
+    std::uint64_t vector = tvec & ~3ull;
+    if (vector == 0){
+        m_pc = epc;
+        m_trap_pending = true;
+        m_trap_cause = cause;
+        return false;
+    }
 
+    m_reservation = UINT64_MAX;
+    std::uint64_t status;
+    if (delegated){
+        store_csr(SEPC, epc);
+        store_csr(SCAUSE, cause);
+        store_csr(STVAL, tval);
+        status = load_csr(SSTATUS);
+        status = (status & ~0x122ull) | ((status & 0x2) << 4) | (mode == Mode::Supervisor ? 0x100 : 0); //SPIE=SIE, SIE=0, SPP=mode
+        store_csr(SSTATUS, status);
+        mode = Mode::Supervisor;
+    } else {
+        store_csr(MEPC, epc);
+        store_csr(MCAUSE, cause);
+        store_csr(MTVAL, tval);
+        status = load_csr(MSTATUS);
+        status = (status & ~0x1888ull) | ((status & 0x8) << 4) | ((std::uint64_t) mode << 11); //MPIE=MIE, MIE=0, MPP=mode
+        store_csr(MSTATUS, status);
+        mode = Mode::Machine;
+    }
+    m_pc = interrupt && (tvec & 3) == 1 ? vector + 4 * code : vector; //vectored mode only applies to interrupts
+    return true;
+}
 
+//a device's interrupt line changed, mip.MEIP follows it and the interrupt is taken if it's enabled.
+//called between blocks, so the interrupted block has finished and m_pc is where to resume
+void CPU::take_interrupt() {
+    std::uint64_t mip = load_csr(MIP);
+    mip = bus.external_interrupt() ? mip | MIP_MEIP : mip & ~MIP_MEIP;
+    csrs[MIP] = mip;
+    if ((mip & load_csr(MIE) & MIP_MEIP) == 0){
+        return;
+    }
+    //enabled by the rules of the mode trap will take it to, and only if there's a handler there.
+    //otherwise it stays pending in mip until a CSR write that might change that, see store_csr
+    bool delegated = mode != Mode::Machine && ((load_csr(MIDELEG) >> CAUSE_MACHINE_EXTERNAL_INTERRUPT) & 1) == 1;
+    bool enabled = delegated ? mode == Mode::User || (load_csr(SSTATUS) & SSTATUS_SIE) != 0
+                             : mode != Mode::Machine || (load_csr(MSTATUS) & MSTATUS_MIE) != 0;
+    if (enabled && (load_csr(delegated ? STVEC : MTVEC) & ~3ull) != 0){
+        trap(m_pc, CAUSE_INTERRUPT | CAUSE_MACHINE_EXTERNAL_INTERRUPT, 0);
+    }
+}
+
+//decodes through the generated dispatch table (decoder.h) and runs the instruction's handler (isa.h)
+template<class Config>
+uint8_t CPU::execute(std::uint64_t instruction, typename Config::Timing& timing) {
+    Decoded decoded = decode((std::uint32_t) instruction);
+    return HANDLERS<Config>[(std::uint16_t) decoded.op](*this, decoded, timing) ? 0 : -1;
+}
@@ -8,22 +8,123 @@
 #include <cstdint>
 #include <cassert>
 #include <cstring>
+#include <chrono>
 #include <cstdio>
+#include <optional>
+#include <set>
 #include <string>
+#include <vector>
 
+#include "accel.h"
 #include "bus.h"
+#include "engine_config.h"
 #include "memory.h"
+#include "monitor.h"
+#include "process.h"
+#include "tiers.h"
+#include "timing.h"
+
+//why a call to CPU::run came back
+enum class StopReason {
+    BudgetExhausted, //ran the number of instructions it was given
+    Breakpoint, //reached a breakpoint, or the pc passed to run_until
+    Deadline, //the deadline passed to run_until went by
+    Trap, //an exception the guest has no handler for (mtvec/stvec unset), cause says which
+    Halted, //the program exited
+    IllegalInstruction, //an instruction that couldn't be decoded and the guest has no handler for
+};
+
+struct RunResult {
+    StopReason reason;
+    std::uint64_t pc; //where execution will resume, for traps and illegal instructions the faulting instruction
+    std::uint64_t instructions; //retired during this call
+    std::uint64_t cause; //mcause style exception code for Trap and IllegalInstruction
+};
+
+//counted by the hart as it goes while monitoring is on, published by StatsPublisher
+struct HartStats {
+    std::uint64_t instructions;
+    std::uint64_t mode_instructions[4]; //by mode, attributed to the mode each block started in
+    std::uint64_t exceptions[STATS_CAUSES];
+    std::uint64_t interrupts[STATS_CAUSES];
+};
+
+//everything needed to carry on from a point in a run, in a fresh CPU set up the same way
+struct Checkpoint {
+    std::uint64_t pc;
+    std::uint64_t mode;
+    std::uint64_t reservation;
+    bool halted;
+    std::vector<std::uint64_t> integer_registers;
+    std::vector<std::uint64_t> floating_point_registers;
+    std::vector<std::uint64_t> csrs;
+    MemorySnapshot memory; //RAM only, mapped files come from the files again so copy on write changes are lost
+    std::optional<Process> process; //user mode only
+};
 
 class CPU {
 public:
     CPU(uint8_t*, uint64_t);
+    //user-mode emulation of a statically linked Linux program: program path, argv and envp
+    CPU(const std::string&, const std::vector<std::string>&, const std::vector<std::string>&);
     ~CPU();
 
-    int8_t cycle();
-    void loop();
+    //executes up to max_instructions, a block at a time, stopping early for any of the StopReasons.
+    //a breakpoint at the pc execution starts from doesn't stop it, so calling run again resumes
+    RunResult run(std::uint64_t max_instructions);
+    //the same, with the cache and branch predictor model estimating how long it all took
+    RunResult run(std::uint64_t max_instructions, CacheTiming&);
+    //the same, counting instructions per basic block for sampled simulation
+    RunResult run(std::uint64_t max_instructions, BbvProfile&);
+    RunResult run_until(std::uint64_t pc, std::uint64_t max_instructions = UINT64_MAX);
+    RunResult run_until(std::chrono::steady_clock::time_point deadline, std::uint64_t max_instructions = UINT64_MAX);
+
+    void add_breakpoint(std::uint64_t pc) { m_breakpoints.insert(pc); }
+    void remove_breakpoint(std::uint64_t pc) { m_breakpoints.erase(pc); }
+
+    std::uint64_t pc() const { return m_pc; }
+    void set_pc(std::uint64_t pc) { m_pc = pc; }
+    //registers and CSRs by number, nothing (or false) if there's no such register
+    std::optional<std::uint64_t> read_register(std::uint64_t reg);
+    bool write_register(std::uint64_t reg, std::uint64_t data);
+    std::optional<std::uint64_t> read_csr(std::uint64_t addr);
+    bool write_csr(std::uint64_t addr, std::uint64_t value);
+    //copy to/from guest RAM, false if the range isn't all RAM
+    bool read_memory(std::uint64_t addr, void* buffer, std::uint64_t len);
+    bool write_memory(std::uint64_t addr, const void* buffer, std::uint64_t len);
+
+    const std::vector<Symbol>& symbols() const;
+
+    bool halted() const { return m_halted; }
+    int exit_code() const { return m_process != nullptr ? m_process->exit_code() : 0; }
+
+    //opt in to running memcpy/memset/memcmp/strlen on the host, see accel.h
+    void enable_accelerator();
+    //maps a serial console at UART_BASE, its host side runs on a separate I/O thread (see io.h)
+    void enable_console(int in_fd, int out_fd) { bus.attach_uart(in_fd, out_fd); }
+    //maps a host file into the physical address space without copying it, see Bus::map_file
+    bool map_file(const std::string& path, std::uint64_t base, bool copy_on_write) {
+        return bus.map_file(path, base, copy_on_write);
+    }
+
+    //publishes live statistics in the named shared memory segment (see monitor.h), false if it couldn't be created
+    bool enable_monitor(const std::string& name);
+    //dumps the registers and CSRs after every instruction
+    void enable_tracing() { m_tracing = true; }
+    //makes a bare-metal hart M-mode only, as on many microcontrollers: mstatus.MPP reads as M whatever is
+    //written, sret is illegal and nothing is delegated, in whichever engine configuration it runs. on its
+    //own it runs in one without any privilege checks (see engine_config.h)
+    void restrict_to_machine_mode();
+
+    Checkpoint checkpoint();
+    //restores into a CPU made the same way as the one the checkpoint came from (same mode, program and memory)
+    void restore(const Checkpoint&);
+    //for re-running part of a program that already ran for real: output is dropped and there's no input
+    void sandbox();
 
     void dump_registers();
     void dump_csrs();
+    void dump_stats();
 private:
     enum Mode {
         User = 0b00,
@@ -37,9 +138,35 @@ private:
     std::uint64_t* csrs; //Control and status registers
     std::uint64_t* m_integer_registers{};
     std::uint64_t* m_floating_point_registers{};
+    Process* m_process{}; //only set when running a user-mode program, ecalls are then serviced by the host
+    Accelerator* m_accel{};
+    TierManager m_tiers;
+    HartStats m_hart_stats{};
+    StatsPublisher* m_monitor{};
+    std::set<std::uint64_t> m_breakpoints;
+    bool m_halted{};
+    bool m_tracing{};
+    bool m_machine_only{};
+    bool m_trap_pending{}; //a trap with no handler, run stops and reports it
+    bool m_trap_taken{}; //an instruction in the middle of a block trapped to its handler, see exception
+    std::uint64_t m_trap_cause{};
+    std::uint64_t m_reservation = UINT64_MAX; //address of the last lr, until an sc or a trap clears it
 
-    uint64_t load(uint64_t, uint64_t);
-    void store(uint64_t, uint64_t, uint64_t);
+    //the instruction handlers, see isa.h
+    template<class> friend struct Exec;
+
+    //false for an access fault, which the caller raises
+    template<class Timing>
+    bool load(Timing& timing, uint64_t addr, uint64_t size, uint64_t& data) {
+        timing.load(addr, size);
+        return bus.load(addr, size, data);
+    }
+
+    template<class Timing>
+    bool store(Timing& timing, uint64_t addr, uint64_t size, uint64_t data) {
+        timing.store(addr, size);
+        return bus.store(addr, size, data);
+    }
 
     uint64_t load_integer_register(std::uint64_t reg);
     void store_integer_register(std::uint64_t reg, std::uint64_t data);
@@ -47,9 +174,43 @@ private:
     std::uint64_t load_csr(std::uint64_t);
     void store_csr(std::uint64_t,std::uint64_t);
 
-    std::uint64_t fetch();
-    uint8_t execute(std::uint64_t);
+    bool fetch(std::uint64_t& instruction);
+    //the execution engine, specialised at compile time for its features and timing model (see engine_config.h
+    //and timing.h). run picks the configuration for what the hart is using
+    template<class Timing> RunResult run(std::uint64_t, std::chrono::steady_clock::time_point, Timing&);
+    unsigned features() const;
+    template<class Config> RunResult run_configured(std::uint64_t, std::chrono::steady_clock::time_point,
+                                                    typename Config::Timing&);
+    template<class Config> uint8_t execute(std::uint64_t, typename Config::Timing&);
+    template<class Config> int8_t run_block(std::uint64_t, std::uint64_t&, typename Config::Timing&);
+    int8_t fault(std::uint64_t);
+    bool exception(std::uint64_t cause, std::uint64_t tval);
+    bool trap(std::uint64_t, std::uint64_t, std::uint64_t);
+    void take_interrupt();
+    void publish_stats(bool force);
 };
+// Exception codes, as written to mcause/scause.
+#define CAUSE_INSTRUCTION_ACCESS_FAULT 1
+#define CAUSE_ILLEGAL_INSTRUCTION 2
+#define CAUSE_BREAKPOINT 3
+#define CAUSE_LOAD_ACCESS_FAULT 5
+#define CAUSE_STORE_ACCESS_FAULT 7 //also for AMOs
+#define CAUSE_ECALL_FROM_U 8
+#define CAUSE_ECALL_FROM_S 9
+#define CAUSE_ECALL_FROM_M 11
+// Interrupt codes, with CAUSE_INTERRUPT set in mcause/scause.
+#define CAUSE_INTERRUPT (1ull << 63)
+#define CAUSE_MACHINE_EXTERNAL_INTERRUPT 11
+
+/// mip/mie bit for machine external interrupts.
+#define MIP_MEIP (1ull << 11)
+/// mstatus global machine interrupt enable.
+#define MSTATUS_MIE 0x8
+/// mstatus previous privilege mode, the mode mret returns to.
+#define MSTATUS_MPP 0x1800
+/// sstatus global supervisor interrupt enable.
+#define SSTATUS_SIE 0x2
+
 //A whole bunch of constants for CSR addresses
 
 // Machine-level CSRs.
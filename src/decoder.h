@@ -0,0 +1,260 @@
+//
+// Created by John on 19/10/2026.
+//
+
+#ifndef CPPRV64_DECODER_H
+#define CPPRV64_DECODER_H
+
+#include <array>
+#include <cstdint>
+
+// The instruction set, described once: handler, mnemonic, mask, match and operand format.
+// A word is that instruction when (word & mask) == match. The dispatch table and immediate
+// decoding below are generated from this list at compile time, and each entry is executed by
+// the handler of the same name in isa.h, so adding an instruction is adding a line here and its handler.
+#define RV64_INSTRUCTIONS(X) \
+    /* RV64I */ \
+    X(lui,        "lui",        0x0000007f, 0x00000037, U) \
+    X(auipc,      "auipc",      0x0000007f, 0x00000017, U) \
+    X(jal,        "jal",        0x0000007f, 0x0000006f, J) \
+    X(jalr,       "jalr",       0x0000707f, 0x00000067, I) \
+    X(beq,        "beq",        0x0000707f, 0x00000063, B) \
+    X(bne,        "bne",        0x0000707f, 0x00001063, B) \
+    X(blt,        "blt",        0x0000707f, 0x00004063, B) \
+    X(bge,        "bge",        0x0000707f, 0x00005063, B) \
+    X(bltu,       "bltu",       0x0000707f, 0x00006063, B) \
+    X(bgeu,       "bgeu",       0x0000707f, 0x00007063, B) \
+    X(lb,         "lb",         0x0000707f, 0x00000003, I) \
+    X(lh,         "lh",         0x0000707f, 0x00001003, I) \
+    X(lw,         "lw",         0x0000707f, 0x00002003, I) \
+    X(ld,         "ld",         0x0000707f, 0x00003003, I) \
+    X(lbu,        "lbu",        0x0000707f, 0x00004003, I) \
+    X(lhu,        "lhu",        0x0000707f, 0x00005003, I) \
+    X(lwu,        "lwu",        0x0000707f, 0x00006003, I) \
+    X(sb,         "sb",         0x0000707f, 0x00000023, S) \
+    X(sh,         "sh",         0x0000707f, 0x00001023, S) \
+    X(sw,         "sw",         0x0000707f, 0x00002023, S) \
+    X(sd,         "sd",         0x0000707f, 0x00003023, S) \
+    X(addi,       "addi",       0x0000707f, 0x00000013, I) \
+    X(slti,       "slti",       0x0000707f, 0x00002013, I) \
+    X(sltiu,      "sltiu",      0x0000707f, 0x00003013, I) \
+    X(xori,       "xori",       0x0000707f, 0x00004013, I) \
+    X(ori,        "ori",        0x0000707f, 0x00006013, I) \
+    X(andi,       "andi",       0x0000707f, 0x00007013, I) \
+    X(slli,       "slli",       0xfc00707f, 0x00001013, Shift64) \
+    X(srli,       "srli",       0xfc00707f, 0x00005013, Shift64) \
+    X(srai,       "srai",       0xfc00707f, 0x40005013, Shift64) \
+    X(add,        "add",        0xfe00707f, 0x00000033, R) \
+    X(sub,        "sub",        0xfe00707f, 0x40000033, R) \
+    X(sll,        "sll",        0xfe00707f, 0x00001033, R) \
+    X(slt,        "slt",        0xfe00707f, 0x00002033, R) \
+    X(sltu,       "sltu",       0xfe00707f, 0x00003033, R) \
+    X(xor_,       "xor",        0xfe00707f, 0x00004033, R) \
+    X(srl,        "srl",        0xfe00707f, 0x00005033, R) \
+    X(sra,        "sra",        0xfe00707f, 0x40005033, R) \
+    X(or_,        "or",         0xfe00707f, 0x00006033, R) \
+    X(and_,       "and",        0xfe00707f, 0x00007033, R) \
+    X(addiw,      "addiw",      0x0000707f, 0x0000001b, I) \
+    X(slliw,      "slliw",      0xfe00707f, 0x0000101b, Shift32) \
+    X(srliw,      "srliw",      0xfe00707f, 0x0000501b, Shift32) \
+    X(sraiw,      "sraiw",      0xfe00707f, 0x4000501b, Shift32) \
+    X(addw,       "addw",       0xfe00707f, 0x0000003b, R) \
+    X(subw,       "subw",       0xfe00707f, 0x4000003b, R) \
+    X(sllw,       "sllw",       0xfe00707f, 0x0000103b, R) \
+    X(srlw,       "srlw",       0xfe00707f, 0x0000503b, R) \
+    X(sraw,       "sraw",       0xfe00707f, 0x4000503b, R) \
+    X(fence,      "fence",      0x0000707f, 0x0000000f, None) \
+    X(fence_i,    "fence.i",    0x0000707f, 0x0000100f, None) \
+    X(ecall,      "ecall",      0xffffffff, 0x00000073, None) \
+    X(ebreak,     "ebreak",     0xffffffff, 0x00100073, None) \
+    X(sret,       "sret",       0xffffffff, 0x10200073, None) \
+    X(mret,       "mret",       0xffffffff, 0x30200073, None) \
+    X(wfi,        "wfi",        0xffffffff, 0x10500073, None) \
+    X(sfence_vma, "sfence.vma", 0xfe007fff, 0x12000073, None) \
+    X(csrrw,      "csrrw",      0x0000707f, 0x00001073, Csr) \
+    X(csrrs,      "csrrs",      0x0000707f, 0x00002073, Csr) \
+    X(csrrc,      "csrrc",      0x0000707f, 0x00003073, Csr) \
+    X(csrrwi,     "csrrwi",     0x0000707f, 0x00005073, Csr) \
+    X(csrrsi,     "csrrsi",     0x0000707f, 0x00006073, Csr) \
+    X(csrrci,     "csrrci",     0x0000707f, 0x00007073, Csr) \
+    /* RV64M */ \
+    X(mul,        "mul",        0xfe00707f, 0x02000033, R) \
+    X(mulh,       "mulh",       0xfe00707f, 0x02001033, R) \
+    X(mulhsu,     "mulhsu",     0xfe00707f, 0x02002033, R) \
+    X(mulhu,      "mulhu",      0xfe00707f, 0x02003033, R) \
+    X(div,        "div",        0xfe00707f, 0x02004033, R) \
+    X(divu,       "divu",       0xfe00707f, 0x02005033, R) \
+    X(rem,        "rem",        0xfe00707f, 0x02006033, R) \
+    X(remu,       "remu",       0xfe00707f, 0x02007033, R) \
+    X(mulw,       "mulw",       0xfe00707f, 0x0200003b, R) \
+    X(divw,       "divw",       0xfe00707f, 0x0200403b, R) \
+    X(divuw,      "divuw",      0xfe00707f, 0x0200503b, R) \
+    X(remw,       "remw",       0xfe00707f, 0x0200603b, R) \
+    X(remuw,      "remuw",      0xfe00707f, 0x0200703b, R) \
+    /* RV64A, aq/rl are ignored as there's only ever one hart */ \
+    X(lr_w,       "lr.w",       0xf9f0707f, 0x1000202f, R) \
+    X(sc_w,       "sc.w",       0xf800707f, 0x1800202f, R) \
+    X(amoswap_w,  "amoswap.w",  0xf800707f, 0x0800202f, R) \
+    X(amoadd_w,   "amoadd.w",   0xf800707f, 0x0000202f, R) \
+    X(amoxor_w,   "amoxor.w",   0xf800707f, 0x2000202f, R) \
+    X(amoand_w,   "amoand.w",   0xf800707f, 0x6000202f, R) \
+    X(amoor_w,    "amoor.w",    0xf800707f, 0x4000202f, R) \
+    X(amomin_w,   "amomin.w",   0xf800707f, 0x8000202f, R) \
+    X(amomax_w,   "amomax.w",   0xf800707f, 0xa000202f, R) \
+    X(amominu_w,  "amominu.w",  0xf800707f, 0xc000202f, R) \
+    X(amomaxu_w,  "amomaxu.w",  0xf800707f, 0xe000202f, R) \
+    X(lr_d,       "lr.d",       0xf9f0707f, 0x1000302f, R) \
+    X(sc_d,       "sc.d",       0xf800707f, 0x1800302f, R) \
+    X(amoswap_d,  "amoswap.d",  0xf800707f, 0x0800302f, R) \
+    X(amoadd_d,   "amoadd.d",   0xf800707f, 0x0000302f, R) \
+    X(amoxor_d,   "amoxor.d",   0xf800707f, 0x2000302f, R) \
+    X(amoand_d,   "amoand.d",   0xf800707f, 0x6000302f, R) \
+    X(amoor_d,    "amoor.d",    0xf800707f, 0x4000302f, R) \
+    X(amomin_d,   "amomin.d",   0xf800707f, 0x8000302f, R) \
+    X(amomax_d,   "amomax.d",   0xf800707f, 0xa000302f, R) \
+    X(amominu_d,  "amominu.d",  0xf800707f, 0xc000302f, R) \
+    X(amomaxu_d,  "amomaxu.d",  0xf800707f, 0xe000302f, R)
+
+//where an instruction keeps its immediate, registers are always in the same place
+enum class Format : std::uint8_t {
+    R, I, S, B, U, J,
+    Shift64, //6 bit shamt in the immediate
+    Shift32, //5 bit shamt in the immediate
+    Csr, //csr address in the immediate, rs1 is the source register or zimm
+    None,
+};
+
+enum class Op : std::uint16_t {
+#define OP(op, name, mask, match, format) op,
+    RV64_INSTRUCTIONS(OP)
+#undef OP
+    illegal, //anything that doesn't match an entry, always last
+};
+
+struct Encoding {
+    const char* name;
+    std::uint32_t mask;
+    std::uint32_t match;
+    Format format;
+};
+
+constexpr Encoding ISA[] = {
+#define ENCODING(op, name, mask, match, format) {name, mask, match, Format::format},
+    RV64_INSTRUCTIONS(ENCODING)
+#undef ENCODING
+};
+constexpr std::uint16_t ISA_SIZE = sizeof(ISA) / sizeof(ISA[0]);
+
+//an instruction decoded once, so running it again is just a call to its handler
+struct Decoded {
+    Op op;
+    std::uint8_t rd;
+    std::uint8_t rs1;
+    std::uint8_t rs2;
+    std::uint32_t word;
+    std::uint64_t imm; //sign extended where the format has a signed immediate
+};
+
+constexpr std::uint64_t sign_extend(std::uint64_t value, unsigned bits) {
+    return (std::uint64_t) ((std::int64_t) (value << (64 - bits)) >> (64 - bits));
+}
+
+constexpr std::uint64_t immediate(std::uint32_t word, Format format) {
+    switch (format) {
+        case Format::I:
+            return sign_extend(word >> 20, 12);
+        case Format::S:
+            return sign_extend(((word >> 20) & 0xfe0) | ((word >> 7) & 0x1f), 12);
+        case Format::B:
+            return sign_extend(((word >> 19) & 0x1000) | ((word << 4) & 0x800)
+                               | ((word >> 20) & 0x7e0) | ((word >> 7) & 0x1e), 13);
+        case Format::U:
+            return sign_extend(word & 0xfffff000, 32);
+        case Format::J:
+            return sign_extend(((word >> 11) & 0x100000) | (word & 0xff000)
+                               | ((word >> 9) & 0x800) | ((word >> 20) & 0x7fe), 21);
+        case Format::Shift64:
+            return (word >> 20) & 0x3f;
+        case Format::Shift32:
+            return (word >> 20) & 0x1f;
+        case Format::Csr:
+            return word >> 20;
+        default:
+            return 0;
+    }
+}
+
+// Dispatch is indexed by the bits that separate most instructions: opcode[6:2], funct3, and
+// bits 25 and 30 of funct7 (M extension, and add/sub or srl/sra). Each slot holds the range of
+// instructions those bits can be. Mostly that's one instruction, confirmed with a single mask
+// compare, the A extension and the privileged instructions share slots and their group is searched.
+constexpr std::uint32_t DISPATCH_BITS = 0x4200707c;
+
+struct DispatchSlot {
+    std::uint16_t first; //ISA_SIZE if nothing can be in the slot
+    std::uint16_t last;
+};
+
+constexpr std::uint32_t dispatch_key(std::uint32_t word) {
+    return ((word >> 2) & 0x1f) | (((word >> 12) & 0x7) << 5) | (((word >> 25) & 0x1) << 8) | (((word >> 30) & 0x1) << 9);
+}
+
+constexpr std::array<DispatchSlot, 1024> DISPATCH = [] {
+    std::array<DispatchSlot, 1024> table{};
+    for (std::uint32_t key = 0; key < table.size(); key++) {
+        std::uint32_t word = ((key & 0x1f) << 2) | (((key >> 5) & 0x7) << 12)
+                             | (((key >> 8) & 0x1) << 25) | (((key >> 9) & 0x1) << 30);
+        table[key] = {ISA_SIZE, 0};
+        for (std::uint16_t i = 0; i < ISA_SIZE; i++) {
+            if (((ISA[i].match ^ word) & ISA[i].mask & DISPATCH_BITS) != 0)
+                continue;
+            if (table[key].first == ISA_SIZE)
+                table[key].first = i;
+            table[key].last = i;
+        }
+    }
+    return table;
+}();
+
+constexpr Op decode_op(std::uint32_t word) {
+    DispatchSlot slot = DISPATCH[dispatch_key(word)];
+    for (std::uint16_t i = slot.first; i <= slot.last; i++) {
+        if ((word & ISA[i].mask) == ISA[i].match)
+            return (Op) i;
+    }
+    return Op::illegal;
+}
+
+constexpr Decoded decode(std::uint32_t word) {
+    Op op = decode_op(word);
+    return {op, (std::uint8_t) ((word >> 7) & 0x1f), (std::uint8_t) ((word >> 15) & 0x1f),
+            (std::uint8_t) ((word >> 20) & 0x1f), word,
+            op != Op::illegal ? immediate(word, ISA[(std::uint16_t) op].format) : 0};
+}
+
+//checked against the table at compile time: no two instructions share an encoding, and every
+//instruction's match decodes back to that instruction through the dispatch table.
+//tests/decode_test.cpp checks every other word against a plain search of the table
+constexpr bool encodings_distinct() {
+    for (std::uint16_t i = 0; i < ISA_SIZE; i++) {
+        for (std::uint16_t j = i + 1; j < ISA_SIZE; j++) {
+            if (((ISA[i].match ^ ISA[j].match) & ISA[i].mask & ISA[j].mask) == 0)
+                return false;
+        }
+    }
+    return true;
+}
+
+constexpr bool dispatch_matches_table() {
+    for (std::uint16_t i = 0; i < ISA_SIZE; i++) {
+        if ((ISA[i].match & ~ISA[i].mask) != 0 || decode_op(ISA[i].match) != (Op) i
+            || decode_op(ISA[i].match | ~ISA[i].mask) != (Op) i) //don't care bits set as well as clear
+            return false;
+    }
+    return true;
+}
+
+static_assert(encodings_distinct(), "two instructions in RV64_INSTRUCTIONS overlap");
+static_assert(dispatch_matches_table(), "the dispatch table doesn't decode RV64_INSTRUCTIONS");
+
+#endif //CPPRV64_DECODER_H
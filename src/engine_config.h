@@ -0,0 +1,33 @@
+//
+// Created by John on 19/10/2026.
+//
+
+#ifndef CPPRV64_ENGINE_CONFIG_H
+#define CPPRV64_ENGINE_CONFIG_H
+
+// What the execution engine may have to deal with. A feature left out of a configuration is compiled
+// out of its loop and instruction handlers altogether, one that's in is still checked for at runtime.
+#define FEATURE_TRACING 0x1 //dumping the registers and CSRs after every instruction, see CPU::enable_tracing
+#define FEATURE_PRIVILEGE 0x2 //supervisor and user mode, with privilege checks. without it the hart is M-mode only
+#define FEATURE_COUNTERS 0x4 //the per hart statistics published for monitoring, see monitor.h
+#define FEATURE_INTERRUPTS 0x8 //devices that can interrupt, polled between blocks
+#define FEATURE_ACCELERATOR 0x10 //host routines for calls and ecalls, see accel.h
+
+// The configurations the engine is built in, for each timing model. run picks the first one that has
+// everything the hart is using, anything else runs with everything.
+#define CONFIG_MACHINE_ONLY FEATURE_INTERRUPTS //bare-metal firmware with a console
+#define CONFIG_USER_PROGRAM (FEATURE_PRIVILEGE | FEATURE_ACCELERATOR) //--user, a pointer compare per call for --accel
+#define CONFIG_EVERYTHING (FEATURE_TRACING | FEATURE_PRIVILEGE | FEATURE_COUNTERS | FEATURE_INTERRUPTS \
+                           | FEATURE_ACCELERATOR)
+
+template<class TimingModel, unsigned Flags>
+struct EngineConfig {
+    using Timing = TimingModel;
+    static constexpr bool tracing = (Flags & FEATURE_TRACING) != 0;
+    static constexpr bool privilege = (Flags & FEATURE_PRIVILEGE) != 0;
+    static constexpr bool counters = (Flags & FEATURE_COUNTERS) != 0;
+    static constexpr bool interrupts = (Flags & FEATURE_INTERRUPTS) != 0;
+    static constexpr bool accelerator = (Flags & FEATURE_ACCELERATOR) != 0;
+};
+
+#endif //CPPRV64_ENGINE_CONFIG_H
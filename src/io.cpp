@@ -0,0 +1,177 @@
+//
+// Created by John on 19/10/2026.
+//
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "io.h"
+
+IoThread::IoThread(std::atomic<std::uint32_t>& interrupts) : m_interrupts(interrupts) {
+    m_epoll = epoll_create1(EPOLL_CLOEXEC);
+    m_wake = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    assert(m_epoll >= 0 && m_wake >= 0 && "Error: Could not set up the I/O thread");
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr; //the wake eventfd is the only event without a channel
+    epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_wake, &event);
+}
+
+IoThread::~IoThread() {
+    if (m_thread.joinable()) {
+        m_stop.store(true);
+        wake();
+        m_thread.join();
+    }
+    for (auto channel : m_channels)
+        delete channel;
+    close(m_wake);
+    close(m_epoll);
+}
+
+Channel* IoThread::open(int in_fd, int out_fd, std::uint32_t irq) {
+    assert(!m_thread.joinable() && "Error: Channels have to be opened before the I/O thread starts");
+    auto channel = new Channel();
+    channel->in_fd = in_fd;
+    channel->out_fd = out_fd;
+    channel->irq = irq;
+    if (in_fd >= 0) {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.ptr = channel;
+        if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, in_fd, &event) != 0) {
+            if (errno == EPERM) //regular files can't be waited on, they're always ready
+                channel->polled = true;
+            else
+                channel->in_fd = -1;
+        }
+    }
+    m_channels.push_back(channel);
+    return channel;
+}
+
+void IoThread::start() {
+    m_thread = std::thread(&IoThread::loop, this);
+}
+
+void IoThread::wake() {
+    std::uint64_t one = 1;
+    while (write(m_wake, &one, sizeof(one)) < 0 && errno == EINTR);
+}
+
+//reads whatever input is waiting into rx, true if there was any
+bool IoThread::receive(Channel& channel) {
+    if (channel.in_fd < 0)
+        return false;
+    std::size_t space = channel.rx.space();
+    if (space == 0) {
+        //stop watching the fd until the guest catches up, otherwise epoll would report it forever
+        if (!channel.polled)
+            epoll_ctl(m_epoll, EPOLL_CTL_DEL, channel.in_fd, nullptr);
+        channel.stalled.store(true);
+        return false;
+    }
+
+    std::uint8_t buffer[4096];
+    ssize_t len = read(channel.in_fd, buffer, std::min(space, sizeof(buffer)));
+    if (len < 0 && (errno == EINTR || errno == EAGAIN))
+        return false;
+    if (len <= 0) { //end of input, or it broke
+        if (!channel.polled)
+            epoll_ctl(m_epoll, EPOLL_CTL_DEL, channel.in_fd, nullptr);
+        channel.in_fd = -1;
+        return false;
+    }
+    for (ssize_t i = 0; i < len; i++)
+        channel.rx.push(buffer[i]);
+    m_interrupts.fetch_or(channel.irq, std::memory_order_release);
+    return true;
+}
+
+//writes out everything in tx, true if there was anything
+bool IoThread::transmit(Channel& channel) {
+    std::uint8_t buffer[4096];
+    bool sent = false;
+    std::size_t len;
+    while ((len = channel.tx.pop(buffer, sizeof(buffer))) != 0) {
+        sent = true;
+        std::size_t written = 0;
+        while (written < len && channel.out_fd >= 0) {
+            ssize_t count = write(channel.out_fd, buffer + written, len - written);
+            if (count < 0 && errno == EINTR)
+                continue;
+            if (count <= 0) { //the reader went away, the guest's output is dropped from here on
+                channel.out_fd = -1;
+                break;
+            }
+            written += count;
+        }
+    }
+    return sent;
+}
+
+bool IoThread::has_work() {
+    if (m_stop.load())
+        return true;
+    for (auto channel : m_channels) {
+        if (!channel->tx.empty() || (channel->stalled.load() && !channel->rx.full()))
+            return true;
+    }
+    return false;
+}
+
+void IoThread::loop() {
+    bool idle = false;
+    epoll_event events[16];
+    while (true) {
+        bool busy = false;
+        for (auto channel : m_channels) {
+            busy |= transmit(*channel);
+            if (channel->stalled.load() && !channel->rx.full()) {
+                channel->stalled.store(false);
+                if (!channel->polled) {
+                    epoll_event event{};
+                    event.events = EPOLLIN;
+                    event.data.ptr = channel;
+                    epoll_ctl(m_epoll, EPOLL_CTL_ADD, channel->in_fd, &event);
+                }
+            }
+            if (channel->polled)
+                busy |= receive(*channel);
+        }
+        if (m_stop.load()) {
+            for (auto channel : m_channels)
+                transmit(*channel);
+            return;
+        }
+
+        int timeout = busy ? 0 : IO_POLL_MS;
+        if (!busy && idle) {
+            //nothing for a while, sleep until there's input or the hart notifies
+            m_sleeping.store(true);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (has_work()) {
+                m_sleeping.store(false);
+                continue;
+            }
+            timeout = -1;
+        }
+        idle = !busy;
+
+        int count = epoll_wait(m_epoll, events, 16, timeout);
+        m_sleeping.store(false);
+        for (int i = 0; i < count; i++) {
+            if (events[i].data.ptr == nullptr) {
+                std::uint64_t value;
+                while (read(m_wake, &value, sizeof(value)) < 0 && errno == EINTR);
+                idle = false;
+            } else {
+                idle = !receive(*static_cast<Channel*>(events[i].data.ptr)) && idle;
+            }
+        }
+    }
+}
@@ -0,0 +1,71 @@
+//
+// Created by John on 19/10/2026.
+//
+
+#ifndef CPPRV64_IO_H
+#define CPPRV64_IO_H
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "ring.h"
+
+#define IO_RING_SIZE 65536 //bytes buffered each way per channel
+#define IO_POLL_MS 1 //how long the I/O thread keeps checking for more output before it goes to sleep
+
+//a byte stream between a device model on the hart and a host file descriptor
+struct Channel {
+    Ring<std::uint8_t, IO_RING_SIZE> rx; //host to guest, pushed by the I/O thread
+    Ring<std::uint8_t, IO_RING_SIZE> tx; //guest to host, pushed by the hart
+    int in_fd;
+    int out_fd;
+    std::uint32_t irq; //bit set in the interrupt word when data arrives
+    bool polled{}; //in_fd can't be waited on (a regular file), so it's just read whenever rx has room
+    std::atomic<bool> stalled{}; //rx filled up and in_fd is no longer being read
+};
+
+// Runs the host side of the guest's devices on its own thread, so a hart never waits on a host
+// file or pipe. Devices hand bytes over through each channel's rings and the thread moves them
+// to and from the host with epoll. Arriving input sets the channel's bit in the interrupt word,
+// which the hart checks between blocks.
+// While output is flowing the thread polls the tx rings every IO_POLL_MS instead of being woken,
+// so a guest writing a byte at a time doesn't pay for a syscall per byte.
+class IoThread {
+private:
+    std::thread m_thread;
+    int m_epoll;
+    int m_wake; //eventfd
+    std::atomic<bool> m_stop{};
+    std::atomic<bool> m_sleeping{};
+    std::vector<Channel*> m_channels;
+    std::atomic<std::uint32_t>& m_interrupts;
+
+    void loop();
+    bool receive(Channel&);
+    bool transmit(Channel&);
+    bool has_work();
+    void wake();
+public:
+    explicit IoThread(std::atomic<std::uint32_t>& interrupts);
+    //stops the thread once everything the guest wrote has gone out
+    ~IoThread();
+
+    IoThread(const IoThread&) = delete;
+    IoThread& operator=(const IoThread&) = delete;
+
+    //channels have to all be opened before start
+    Channel* open(int in_fd, int out_fd, std::uint32_t irq);
+    void start();
+
+    //hart side, after pushing to a tx ring or popping from a stalled rx ring
+    void notify() {
+        //pairs with the fence in loop, one side or the other sees the ring has something in it
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_sleeping.load(std::memory_order_relaxed) && m_sleeping.exchange(false))
+            wake();
+    }
+};
+
+#endif //CPPRV64_IO_H
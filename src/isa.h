@@ -0,0 +1,385 @@
+//
+// Created by John on 19/10/2026.
+//
+
+#ifndef CPPRV64_ISA_H
+#define CPPRV64_ISA_H
+
+#include "cpu.h"
+#include "decoder.h"
+
+// What each instruction in RV64_INSTRUCTIONS does. The handlers are specialised for the engine's
+// configuration (see engine_config.h) like the rest of the engine, and return false if the instruction
+// faulted with no handler to take the trap (or is illegal), which stops the block it's in.
+// Every handler runs with m_pc already pointing at the next instruction.
+template<class Config>
+struct Exec {
+    using Timing = typename Config::Timing;
+    using Handler = bool (*)(CPU&, const Decoded&, Timing&);
+
+#define INSTRUCTION(name) static bool name([[maybe_unused]] CPU& cpu, [[maybe_unused]] const Decoded& d, \
+                                           [[maybe_unused]] Timing& timing)
+
+    //register numbers come out of 5 bit fields so they can't be out of range, and x0 is never written
+    static std::uint64_t x(CPU& cpu, std::uint8_t reg) { return cpu.m_integer_registers[reg]; }
+    static void set(CPU& cpu, std::uint8_t reg, std::uint64_t data) {
+        if (reg != 0)
+            cpu.m_integer_registers[reg] = data;
+    }
+    static std::uint64_t pc(CPU& cpu) { return cpu.m_pc - 4; }
+    static std::uint64_t sext32(std::uint64_t value) { return (std::int64_t) (std::int32_t) value; }
+
+    static bool jump(CPU& cpu, const Decoded& d, Timing& timing, std::uint64_t target) {
+        std::uint64_t link = cpu.m_pc;
+        cpu.m_pc = target;
+        set(cpu, d.rd, link);
+        if constexpr (Config::accelerator) {
+            if (cpu.m_accel != nullptr && cpu.m_accel->intercept(target, cpu.m_integer_registers, cpu.bus)) {
+                cpu.m_pc = x(cpu, 1); //the host did the call, return straight to the caller
+                return true; //and it never returns through ret, so the timing model doesn't see it
+            }
+        }
+        if (d.rd == 1)
+            timing.call(target);
+        return true;
+    }
+
+    //the lowest privilege level that can access a CSR is in its address. an M-mode only hart can access them all
+    static bool csr_allowed(CPU& cpu, std::uint64_t csr) {
+        if constexpr (Config::privilege)
+            return ((csr >> 8) & 0b11) <= cpu.mode;
+        return true;
+    }
+
+    //an M-mode only hart, whichever configuration it ended up running in (tracing or --accel take it into one
+    //with privilege), so it behaves the same in all of them
+    static bool machine_only(CPU& cpu) {
+        if constexpr (Config::privilege)
+            return cpu.m_machine_only;
+        return true;
+    }
+
+    static bool branch(CPU& cpu, const Decoded& d, Timing& timing, bool taken) {
+        timing.branch(pc(cpu), taken);
+        if (taken)
+            cpu.m_pc = pc(cpu) + d.imm;
+        return true;
+    }
+
+    static bool load(CPU& cpu, const Decoded& d, Timing& timing, std::uint64_t size, bool sign) {
+        std::uint64_t addr = x(cpu, d.rs1) + d.imm, data;
+        if (!cpu.load(timing, addr, size, data))
+            return cpu.exception(CAUSE_LOAD_ACCESS_FAULT, addr);
+        set(cpu, d.rd, sign ? sign_extend(data, size) : data);
+        return true;
+    }
+
+    static bool store(CPU& cpu, const Decoded& d, Timing& timing, std::uint64_t size) {
+        std::uint64_t addr = x(cpu, d.rs1) + d.imm;
+        if (!cpu.store(timing, addr, size, x(cpu, d.rs2)))
+            return cpu.exception(CAUSE_STORE_ACCESS_FAULT, addr);
+        return true;
+    }
+
+    template<class Operation>
+    static bool amo(CPU& cpu, const Decoded& d, Timing& timing, std::uint64_t size, Operation operation) {
+        std::uint64_t addr = x(cpu, d.rs1), old;
+        if (!cpu.load(timing, addr, size, old))
+            return cpu.exception(CAUSE_STORE_ACCESS_FAULT, addr);
+        if (size == 32)
+            old = sext32(old);
+        if (!cpu.store(timing, addr, size, operation(old, x(cpu, d.rs2))))
+            return cpu.exception(CAUSE_STORE_ACCESS_FAULT, addr);
+        set(cpu, d.rd, old);
+        return true;
+    }
+
+    INSTRUCTION(lui) { set(cpu, d.rd, d.imm); return true; }
+    INSTRUCTION(auipc) { set(cpu, d.rd, pc(cpu) + d.imm); return true; }
+    INSTRUCTION(jal) { return jump(cpu, d, timing, pc(cpu) + d.imm); }
+    INSTRUCTION(jalr) {
+        if (d.rd == 0 && d.rs1 == 1)
+            timing.ret();
+        return jump(cpu, d, timing, (x(cpu, d.rs1) + d.imm) & ~1ull);
+    }
+
+    INSTRUCTION(beq) { return branch(cpu, d, timing, x(cpu, d.rs1) == x(cpu, d.rs2)); }
+    INSTRUCTION(bne) { return branch(cpu, d, timing, x(cpu, d.rs1) != x(cpu, d.rs2)); }
+    INSTRUCTION(blt) { return branch(cpu, d, timing, (std::int64_t) x(cpu, d.rs1) < (std::int64_t) x(cpu, d.rs2)); }
+    INSTRUCTION(bge) { return branch(cpu, d, timing, (std::int64_t) x(cpu, d.rs1) >= (std::int64_t) x(cpu, d.rs2)); }
+    INSTRUCTION(bltu) { return branch(cpu, d, timing, x(cpu, d.rs1) < x(cpu, d.rs2)); }
+    INSTRUCTION(bgeu) { return branch(cpu, d, timing, x(cpu, d.rs1) >= x(cpu, d.rs2)); }
+
+    INSTRUCTION(lb) { return load(cpu, d, timing, 8, true); }
+    INSTRUCTION(lh) { return load(cpu, d, timing, 16, true); }
+    INSTRUCTION(lw) { return load(cpu, d, timing, 32, true); }
+    INSTRUCTION(ld) { return load(cpu, d, timing, 64, false); }
+    INSTRUCTION(lbu) { return load(cpu, d, timing, 8, false); }
+    INSTRUCTION(lhu) { return load(cpu, d, timing, 16, false); }
+    INSTRUCTION(lwu) { return load(cpu, d, timing, 32, false); }
+    INSTRUCTION(sb) { return store(cpu, d, timing, 8); }
+    INSTRUCTION(sh) { return store(cpu, d, timing, 16); }
+    INSTRUCTION(sw) { return store(cpu, d, timing, 32); }
+    INSTRUCTION(sd) { return store(cpu, d, timing, 64); }
+
+    INSTRUCTION(addi) { set(cpu, d.rd, x(cpu, d.rs1) + d.imm); return true; }
+    INSTRUCTION(slti) { set(cpu, d.rd, (std::int64_t) x(cpu, d.rs1) < (std::int64_t) d.imm ? 1 : 0); return true; }
+    INSTRUCTION(sltiu) { set(cpu, d.rd, x(cpu, d.rs1) < d.imm ? 1 : 0); return true; }
+    INSTRUCTION(xori) { set(cpu, d.rd, x(cpu, d.rs1) ^ d.imm); return true; }
+    INSTRUCTION(ori) { set(cpu, d.rd, x(cpu, d.rs1) | d.imm); return true; }
+    INSTRUCTION(andi) { set(cpu, d.rd, x(cpu, d.rs1) & d.imm); return true; }
+    INSTRUCTION(slli) { set(cpu, d.rd, x(cpu, d.rs1) << d.imm); return true; }
+    INSTRUCTION(srli) { set(cpu, d.rd, x(cpu, d.rs1) >> d.imm); return true; }
+    INSTRUCTION(srai) { set(cpu, d.rd, (std::int64_t) x(cpu, d.rs1) >> d.imm); return true; }
+
+    INSTRUCTION(add) { set(cpu, d.rd, x(cpu, d.rs1) + x(cpu, d.rs2)); return true; }
+    INSTRUCTION(sub) { set(cpu, d.rd, x(cpu, d.rs1) - x(cpu, d.rs2)); return true; }
+    INSTRUCTION(sll) { set(cpu, d.rd, x(cpu, d.rs1) << (x(cpu, d.rs2) & 0x3f)); return true; }
+    INSTRUCTION(slt) { set(cpu, d.rd, (std::int64_t) x(cpu, d.rs1) < (std::int64_t) x(cpu, d.rs2) ? 1 : 0); return true; }
+    INSTRUCTION(sltu) { set(cpu, d.rd, x(cpu, d.rs1) < x(cpu, d.rs2) ? 1 : 0); return true; }
+    INSTRUCTION(xor_) { set(cpu, d.rd, x(cpu, d.rs1) ^ x(cpu, d.rs2)); return true; }
+    INSTRUCTION(srl) { set(cpu, d.rd, x(cpu, d.rs1) >> (x(cpu, d.rs2) & 0x3f)); return true; }
+    INSTRUCTION(sra) { set(cpu, d.rd, (std::int64_t) x(cpu, d.rs1) >> (x(cpu, d.rs2) & 0x3f)); return true; }
+    INSTRUCTION(or_) { set(cpu, d.rd, x(cpu, d.rs1) | x(cpu, d.rs2)); return true; }
+    INSTRUCTION(and_) { set(cpu, d.rd, x(cpu, d.rs1) & x(cpu, d.rs2)); return true; }
+
+    INSTRUCTION(addiw) { set(cpu, d.rd, sext32(x(cpu, d.rs1) + d.imm)); return true; }
+    INSTRUCTION(slliw) { set(cpu, d.rd, sext32((std::uint32_t) x(cpu, d.rs1) << d.imm)); return true; }
+    INSTRUCTION(srliw) { set(cpu, d.rd, sext32((std::uint32_t) x(cpu, d.rs1) >> d.imm)); return true; }
+    INSTRUCTION(sraiw) { set(cpu, d.rd, sext32((std::int32_t) x(cpu, d.rs1) >> d.imm)); return true; }
+    INSTRUCTION(addw) { set(cpu, d.rd, sext32(x(cpu, d.rs1) + x(cpu, d.rs2))); return true; }
+    INSTRUCTION(subw) { set(cpu, d.rd, sext32(x(cpu, d.rs1) - x(cpu, d.rs2))); return true; }
+    INSTRUCTION(sllw) { set(cpu, d.rd, sext32((std::uint32_t) x(cpu, d.rs1) << (x(cpu, d.rs2) & 0x1f))); return true; }
+    INSTRUCTION(srlw) { set(cpu, d.rd, sext32((std::uint32_t) x(cpu, d.rs1) >> (x(cpu, d.rs2) & 0x1f))); return true; }
+    INSTRUCTION(sraw) { set(cpu, d.rd, sext32((std::int32_t) x(cpu, d.rs1) >> (x(cpu, d.rs2) & 0x1f))); return true; }
+
+    INSTRUCTION(fence) { return true; } //memory is always coherent here
+    INSTRUCTION(fence_i) { cpu.m_tiers.invalidate(); return true; }
+    INSTRUCTION(wfi) { return true; }
+    INSTRUCTION(sfence_vma) { return true; }
+
+    INSTRUCTION(ecall) {
+        if constexpr (Config::accelerator) {
+            if (cpu.m_accel != nullptr && x(cpu, 17) >= HOSTCALL_BASE) {
+                cpu.m_accel->hostcall(cpu.m_integer_registers, cpu.bus);
+                return true;
+            }
+        }
+        if constexpr (!Config::privilege)
+            return cpu.trap(pc(cpu), CAUSE_ECALL_FROM_M, 0);
+        if (cpu.m_process == nullptr || cpu.mode != CPU::Mode::User) {
+            std::uint64_t cause = cpu.mode == CPU::Mode::User ? CAUSE_ECALL_FROM_U
+                                  : cpu.mode == CPU::Mode::Supervisor ? CAUSE_ECALL_FROM_S : CAUSE_ECALL_FROM_M;
+            return cpu.trap(pc(cpu), cause, 0);
+        }
+        if (cpu.m_process->syscall(cpu.m_integer_registers, cpu.bus))
+            cpu.m_tiers.invalidate();
+        cpu.m_halted = cpu.m_process->exited();
+        return true;
+    }
+
+    INSTRUCTION(ebreak) { return cpu.trap(pc(cpu), CAUSE_BREAKPOINT, pc(cpu)); }
+
+    INSTRUCTION(sret) {
+        if (machine_only(cpu) || cpu.mode == CPU::Mode::User)
+            return false;
+        cpu.m_pc = cpu.load_csr(SEPC);
+        cpu.mode = ((cpu.load_csr(SSTATUS) >> 8) & 1) == 1 ? CPU::Mode::Supervisor : CPU::Mode::User;
+        cpu.store_csr(SSTATUS, ((cpu.load_csr(SSTATUS) >> 5) & 1) == 1 ? cpu.load_csr(SSTATUS) | 2 : cpu.load_csr(SSTATUS) & 0xFFFFFFFFFFFFFFFD);
+        cpu.store_csr(SSTATUS, cpu.load_csr(SSTATUS) | 32);
+        cpu.store_csr(SSTATUS, cpu.load_csr(SSTATUS) & 0xFFFFFFFFFFFFFEFF);
+        return true;
+    }
+
+    INSTRUCTION(mret) {
+        if (Config::privilege && cpu.mode != CPU::Mode::Machine)
+            return false;
+        cpu.m_pc = cpu.load_csr(MEPC);
+        switch (machine_only(cpu) ? 3 : (cpu.load_csr(MSTATUS) >> 11) & 0b11) { //MPP is always M without the others
+            case 3:
+                cpu.mode = CPU::Mode::Machine;
+                break;
+            case 1:
+                cpu.mode = CPU::Mode::Supervisor;
+                break;
+            default:
+                cpu.mode = CPU::Mode::User;
+                break;
+        }
+        cpu.store_csr(MSTATUS, ((cpu.load_csr(MSTATUS) >> 7) & 1) == 1 ? cpu.load_csr(MSTATUS) | 8 : cpu.load_csr(MSTATUS) & 0xFFFFFFFFFFFFFFF7);
+        return true;
+    }
+
+    //the csr is read before the register in case rd == rs1
+    INSTRUCTION(csrrw) {
+        if (!csr_allowed(cpu, d.imm))
+            return false;
+        std::uint64_t old = cpu.load_csr(d.imm);
+        cpu.store_csr(d.imm, x(cpu, d.rs1));
+        set(cpu, d.rd, old);
+        return true;
+    }
+    INSTRUCTION(csrrs) {
+        if (!csr_allowed(cpu, d.imm))
+            return false;
+        std::uint64_t old = cpu.load_csr(d.imm);
+        cpu.store_csr(d.imm, old | x(cpu, d.rs1));
+        set(cpu, d.rd, old);
+        return true;
+    }
+    INSTRUCTION(csrrc) {
+        if (!csr_allowed(cpu, d.imm))
+            return false;
+        std::uint64_t old = cpu.load_csr(d.imm);
+        cpu.store_csr(d.imm, old & ~x(cpu, d.rs1));
+        set(cpu, d.rd, old);
+        return true;
+    }
+    INSTRUCTION(csrrwi) {
+        if (!csr_allowed(cpu, d.imm))
+            return false;
+        set(cpu, d.rd, cpu.load_csr(d.imm));
+        cpu.store_csr(d.imm, d.rs1);
+        return true;
+    }
+    INSTRUCTION(csrrsi) {
+        if (!csr_allowed(cpu, d.imm))
+            return false;
+        std::uint64_t old = cpu.load_csr(d.imm);
+        cpu.store_csr(d.imm, old | d.rs1);
+        set(cpu, d.rd, old);
+        return true;
+    }
+    INSTRUCTION(csrrci) {
+        if (!csr_allowed(cpu, d.imm))
+            return false;
+        std::uint64_t old = cpu.load_csr(d.imm);
+        cpu.store_csr(d.imm, old & ~(std::uint64_t) d.rs1);
+        set(cpu, d.rd, old);
+        return true;
+    }
+
+    //division by zero and overflow give the results the spec defines rather than trapping
+    INSTRUCTION(mul) { set(cpu, d.rd, x(cpu, d.rs1) * x(cpu, d.rs2)); return true; }
+    INSTRUCTION(mulh) {
+        set(cpu, d.rd, (std::uint64_t) (((__int128) (std::int64_t) x(cpu, d.rs1) * (std::int64_t) x(cpu, d.rs2)) >> 64));
+        return true;
+    }
+    INSTRUCTION(mulhsu) {
+        set(cpu, d.rd, (std::uint64_t) (((__int128) (std::int64_t) x(cpu, d.rs1) * (__int128) x(cpu, d.rs2)) >> 64));
+        return true;
+    }
+    INSTRUCTION(mulhu) {
+        set(cpu, d.rd, (std::uint64_t) (((unsigned __int128) x(cpu, d.rs1) * x(cpu, d.rs2)) >> 64));
+        return true;
+    }
+    INSTRUCTION(div) {
+        auto a = (std::int64_t) x(cpu, d.rs1), b = (std::int64_t) x(cpu, d.rs2);
+        set(cpu, d.rd, b == 0 ? -1 : (a == INT64_MIN && b == -1) ? a : a / b);
+        return true;
+    }
+    INSTRUCTION(divu) {
+        std::uint64_t a = x(cpu, d.rs1), b = x(cpu, d.rs2);
+        set(cpu, d.rd, b == 0 ? UINT64_MAX : a / b);
+        return true;
+    }
+    INSTRUCTION(rem) {
+        auto a = (std::int64_t) x(cpu, d.rs1), b = (std::int64_t) x(cpu, d.rs2);
+        set(cpu, d.rd, b == 0 ? a : (a == INT64_MIN && b == -1) ? 0 : a % b);
+        return true;
+    }
+    INSTRUCTION(remu) {
+        std::uint64_t a = x(cpu, d.rs1), b = x(cpu, d.rs2);
+        set(cpu, d.rd, b == 0 ? a : a % b);
+        return true;
+    }
+    INSTRUCTION(mulw) { set(cpu, d.rd, sext32(x(cpu, d.rs1) * x(cpu, d.rs2))); return true; }
+    INSTRUCTION(divw) {
+        auto a = (std::int32_t) x(cpu, d.rs1), b = (std::int32_t) x(cpu, d.rs2);
+        set(cpu, d.rd, b == 0 ? -1 : (a == INT32_MIN && b == -1) ? sext32(a) : sext32(a / b));
+        return true;
+    }
+    INSTRUCTION(divuw) {
+        auto a = (std::uint32_t) x(cpu, d.rs1), b = (std::uint32_t) x(cpu, d.rs2);
+        set(cpu, d.rd, b == 0 ? UINT64_MAX : sext32(a / b));
+        return true;
+    }
+    INSTRUCTION(remw) {
+        auto a = (std::int32_t) x(cpu, d.rs1), b = (std::int32_t) x(cpu, d.rs2);
+        set(cpu, d.rd, b == 0 ? sext32(a) : (a == INT32_MIN && b == -1) ? 0 : sext32(a % b));
+        return true;
+    }
+    INSTRUCTION(remuw) {
+        auto a = (std::uint32_t) x(cpu, d.rs1), b = (std::uint32_t) x(cpu, d.rs2);
+        set(cpu, d.rd, b == 0 ? sext32(a) : sext32(a % b));
+        return true;
+    }
+
+    //with a single hart a reservation can only be lost to another sc, or an lr elsewhere
+    static bool load_reserved(CPU& cpu, const Decoded& d, Timing& timing, std::uint64_t size) {
+        std::uint64_t data;
+        if (!cpu.load(timing, x(cpu, d.rs1), size, data))
+            return cpu.exception(CAUSE_LOAD_ACCESS_FAULT, x(cpu, d.rs1));
+        cpu.m_reservation = x(cpu, d.rs1);
+        set(cpu, d.rd, size == 32 ? sext32(data) : data);
+        return true;
+    }
+    INSTRUCTION(lr_w) { return load_reserved(cpu, d, timing, 32); }
+    INSTRUCTION(lr_d) { return load_reserved(cpu, d, timing, 64); }
+    static bool store_conditional(CPU& cpu, const Decoded& d, Timing& timing, std::uint64_t size) {
+        bool reserved = cpu.m_reservation == x(cpu, d.rs1);
+        if (reserved && !cpu.store(timing, x(cpu, d.rs1), size, x(cpu, d.rs2)))
+            return cpu.exception(CAUSE_STORE_ACCESS_FAULT, x(cpu, d.rs1));
+        cpu.m_reservation = UINT64_MAX;
+        set(cpu, d.rd, reserved ? 0 : 1);
+        return true;
+    }
+    INSTRUCTION(sc_w) { return store_conditional(cpu, d, timing, 32); }
+    INSTRUCTION(sc_d) { return store_conditional(cpu, d, timing, 64); }
+
+    INSTRUCTION(amoswap_w) { return amo(cpu, d, timing, 32, [](std::uint64_t, std::uint64_t b) { return b; }); }
+    INSTRUCTION(amoadd_w) { return amo(cpu, d, timing, 32, [](std::uint64_t a, std::uint64_t b) { return a + b; }); }
+    INSTRUCTION(amoxor_w) { return amo(cpu, d, timing, 32, [](std::uint64_t a, std::uint64_t b) { return a ^ b; }); }
+    INSTRUCTION(amoand_w) { return amo(cpu, d, timing, 32, [](std::uint64_t a, std::uint64_t b) { return a & b; }); }
+    INSTRUCTION(amoor_w) { return amo(cpu, d, timing, 32, [](std::uint64_t a, std::uint64_t b) { return a | b; }); }
+    INSTRUCTION(amomin_w) {
+        return amo(cpu, d, timing, 32, [](std::uint64_t a, std::uint64_t b) { return (std::int32_t) a < (std::int32_t) b ? a : b; });
+    }
+    INSTRUCTION(amomax_w) {
+        return amo(cpu, d, timing, 32, [](std::uint64_t a, std::uint64_t b) { return (std::int32_t) a > (std::int32_t) b ? a : b; });
+    }
+    INSTRUCTION(amominu_w) {
+        return amo(cpu, d, timing, 32, [](std::uint64_t a, std::uint64_t b) { return (std::uint32_t) a < (std::uint32_t) b ? a : b; });
+    }
+    INSTRUCTION(amomaxu_w) {
+        return amo(cpu, d, timing, 32, [](std::uint64_t a, std::uint64_t b) { return (std::uint32_t) a > (std::uint32_t) b ? a : b; });
+    }
+    INSTRUCTION(amoswap_d) { return amo(cpu, d, timing, 64, [](std::uint64_t, std::uint64_t b) { return b; }); }
+    INSTRUCTION(amoadd_d) { return amo(cpu, d, timing, 64, [](std::uint64_t a, std::uint64_t b) { return a + b; }); }
+    INSTRUCTION(amoxor_d) { return amo(cpu, d, timing, 64, [](std::uint64_t a, std::uint64_t b) { return a ^ b; }); }
+    INSTRUCTION(amoand_d) { return amo(cpu, d, timing, 64, [](std::uint64_t a, std::uint64_t b) { return a & b; }); }
+    INSTRUCTION(amoor_d) { return amo(cpu, d, timing, 64, [](std::uint64_t a, std::uint64_t b) { return a | b; }); }
+    INSTRUCTION(amomin_d) {
+        return amo(cpu, d, timing, 64, [](std::uint64_t a, std::uint64_t b) { return (std::int64_t) a < (std::int64_t) b ? a : b; });
+    }
+    INSTRUCTION(amomax_d) {
+        return amo(cpu, d, timing, 64, [](std::uint64_t a, std::uint64_t b) { return (std::int64_t) a > (std::int64_t) b ? a : b; });
+    }
+    INSTRUCTION(amominu_d) { return amo(cpu, d, timing, 64, [](std::uint64_t a, std::uint64_t b) { return a < b ? a : b; }); }
+    INSTRUCTION(amomaxu_d) { return amo(cpu, d, timing, 64, [](std::uint64_t a, std::uint64_t b) { return a > b ? a : b; }); }
+
+    INSTRUCTION(illegal) { return false; }
+
+#undef INSTRUCTION
+};
+
+//indexed by Op, so dispatching a decoded instruction is one indexed call
+template<class Config>
+constexpr typename Exec<Config>::Handler HANDLERS[] = {
+#define HANDLER(op, name, mask, match, format) &Exec<Config>::op,
+        RV64_INSTRUCTIONS(HANDLER)
+#undef HANDLER
+        &Exec<Config>::illegal,
+};
+
+#endif //CPPRV64_ISA_H
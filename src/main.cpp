@@ -1,9 +1,14 @@
 //
 // Created by John on 15/12/2022.
 //
+#include <cerrno>
 #include <fstream>
+#include <functional>
+#include <unistd.h>
+#include <vector>
 
 #include "cpu.h"
+#include "sampler.h"
 
 #include <algorithm>
 
@@ -17,13 +22,163 @@ void loadFile(const std::string& filename, uint8_t* data, std::int64_t size) {
     file.read(reinterpret_cast<char*>(data), size);
 }
 
+extern char** environ;
+
+//a whole command line number (decimal, 0x hex or 0 octal), false if any of it isn't one or it doesn't fit
+bool parse_number(const char* text, std::uint64_t& value){
+    char* end = nullptr;
+    errno = 0;
+    value = std::strtoull(text, &end, 0);
+    //strtoull would take leading spaces and a minus sign too
+    return *text >= '0' && *text <= '9' && end != text && *end == '\0' && errno == 0;
+}
+
+struct MappedFile {
+    std::string path;
+    std::uint64_t base;
+    bool copy_on_write;
+};
+
+struct Options {
+    bool user = false; //--user <program> [args...] : run a statically linked RV64 Linux program
+    bool accel = false; //--accel : run memcpy/memset/memcmp/strlen on the host
+    bool stats = false; //--stats : print execution statistics to stderr on exit
+    bool timing = false; //--timing : estimate cycles with the cache and branch predictor model
+    std::uint64_t sample = 0; //--sample <interval> : estimate cycles from sampled intervals of this many instructions
+    std::string monitor; //--monitor <name> : publish live statistics in this shared memory segment, see rv64stat
+    std::vector<MappedFile> files; //--map <file>@<addr>, --map-cow <file>@<addr> : map a host file into guest memory
+    bool trace = false; //--trace : dump the registers and CSRs after every instruction
+    bool machine_only = false; //--machine-only : a bare-metal hart with M-mode only
+};
+
+//what every CPU made for a run needs, the first one and any made for sampling
+bool set_up(CPU& cpu, const Options& options){
+    if (options.accel)
+        cpu.enable_accelerator();
+    if (options.machine_only)
+        cpu.restrict_to_machine_mode();
+    for (auto& file : options.files)
+        if (!cpu.map_file(file.path, file.base, file.copy_on_write))
+            return false;
+    return true;
+}
+
+void report(const RunResult& result){
+    switch (result.reason){
+        case StopReason::Halted:
+        case StopReason::BudgetExhausted:
+        case StopReason::Breakpoint:
+        case StopReason::Deadline:
+            break;
+        case StopReason::Trap:
+            fprintf(stderr, "Stopped: unhandled trap (cause %lu) at PC %lX\n", result.cause, result.pc);
+            break;
+        case StopReason::IllegalInstruction:
+            fprintf(stderr, "Stopped: illegal instruction at PC %lX\n", result.pc);
+            break;
+    }
+}
+
+//runs to completion, through the timing model if it was asked for.
+//make builds another CPU set up the same way, for sampling
+void run(CPU& cpu, const Options& options, const std::function<CPU*()>& make){
+    if (options.sample != 0){
+        SampleReport sampled = Sampler(options.sample).run(cpu, make);
+        sampled.dump_stats();
+        report(sampled.stop);
+    } else if (options.timing){
+        CacheTiming timing;
+        report(cpu.run(UINT64_MAX, timing));
+        timing.dump_stats(cpu.symbols());
+    } else {
+        report(cpu.run(UINT64_MAX));
+    }
+}
+
+//runs a statically linked RV64 Linux program with its syscalls done by the host
+int run_user_program(const Options& options, int argc, char** argv){
+    std::vector<std::string> args(argv, argv + argc);
+    std::vector<std::string> env;
+    for (char** var = environ; *var != nullptr; var++)
+        env.emplace_back(*var);
+
+    auto process = CPU(args[0], args, env);
+    if (process.halted() || !set_up(process, options))
+        return 1;
+    if (!options.monitor.empty() && !process.enable_monitor(options.monitor))
+        return 1;
+    if (options.trace)
+        process.enable_tracing();
+    run(process, options, [&](){
+        auto copy = new CPU(args[0], args, env);
+        set_up(*copy, options);
+        return copy;
+    });
+    if (options.stats)
+        process.dump_stats();
+    return process.exit_code();
+}
+
 int main(int argc, char** argv){
+    Options options;
+    int arg = 1;
+    for (; arg < argc && std::string(argv[arg]).rfind("--", 0) == 0 && !options.user; arg++){
+        std::string option = argv[arg];
+        if (option == "--user"){
+            options.user = true;
+        } else if (option == "--accel"){
+            options.accel = true;
+        } else if (option == "--stats"){
+            options.stats = true;
+        } else if (option == "--timing"){
+            options.timing = true;
+        } else if (option == "--trace"){
+            options.trace = true;
+        } else if (option == "--machine-only"){
+            options.machine_only = true;
+        } else if (option == "--monitor" && arg + 1 < argc){
+            options.monitor = argv[++arg];
+        } else if ((option == "--map" || option == "--map-cow") && arg + 1 < argc){
+            std::string mapping = argv[++arg];
+            auto at = mapping.rfind('@');
+            if (at == std::string::npos || at == 0){
+                printf("Error: %s needs <file>@<address>\n", option.c_str());
+                return 1;
+            }
+            std::uint64_t base;
+            if (!parse_number(mapping.c_str() + at + 1, base)){
+                printf("Error: %s address %s isn't a number\n", option.c_str(), mapping.c_str() + at + 1);
+                return 1;
+            }
+            options.files.push_back({mapping.substr(0, at), base, option == "--map-cow"});
+        } else if (option == "--sample" && arg + 1 < argc){
+            if (!parse_number(argv[++arg], options.sample) || options.sample == 0){
+                printf("Error: --sample needs an interval length\n");
+                return 1;
+            }
+        } else {
+            printf("Error: Unknown option %s\n", option.c_str());
+            return 1;
+        }
+    }
+    if (options.user){
+        if (options.machine_only){
+            printf("Error: --machine-only is for bare-metal images\n");
+            return 1;
+        }
+        if (arg == argc){
+            printf("Error: --user needs a program to run\n");
+            return 1;
+        }
+        return run_user_program(options, argc - arg, argv + arg);
+    }
+
     std::string filename;
-    if (argc < 2){
+    if (arg == argc){
         filename = "../test.bin";
     }
     else {
-        filename = *argv[1];
+        filename = argv[arg];
     }
     auto code = new uint8_t[1024];
 
@@ -37,8 +192,17 @@ int main(int argc, char** argv){
 //    printf("\n");
 
     auto test = CPU(code, 1024);
-
-    delete[] code;
+    if (!set_up(test, options)){
+        delete[] code;
+        return 1;
+    }
+    test.enable_console(STDIN_FILENO, STDOUT_FILENO);
+    if (!options.monitor.empty() && !test.enable_monitor(options.monitor)){
+        delete[] code;
+        return 1;
+    }
+    if (options.trace)
+        test.enable_tracing();
 //    std::uint8_t code[] = {0x93, 0x0E, 0x50, 0x00,
 //                           0x13, 0x0F, 0x50, 0x02,
 //                           0xB3, 0x0F, 0xDF, 0x01}; //this is in add-addi.bin
@@ -50,9 +214,17 @@ int main(int argc, char** argv){
 //    test.cycle();
 //    test.cycle();
     test.dump_registers();
-    test.loop();
+    fflush(stdout); //the console writes straight to the fd from the I/O thread
+    run(test, options, [&](){
+        auto copy = new CPU(code, 1024);
+        set_up(*copy, options);
+        return copy;
+    });
+    delete[] code;
     test.dump_registers();
     test.dump_csrs();
+    if (options.stats)
+        test.dump_stats();
 
     return 0;
 }
\ No newline at end of file
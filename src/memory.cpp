@@ -2,10 +2,122 @@
 // Created by John on 15/12/2022.
 //
 
+#include <algorithm>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "memory.h"
 
+#define PAGEMAP_PRESENT (1ull << 63)
+#define PAGEMAP_SWAPPED (1ull << 62)
+
+Memory::Memory(uint64_t base, uint64_t size) : m_base(base), m_size(size) {
+    //anonymous mappings are zero filled lazily, so a large guest RAM costs nothing until it is touched
+    void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    assert(mapping != MAP_FAILED && "Error: Could not allocate guest memory");
+    memory = static_cast<std::uint8_t*>(mapping);
+}
+
+Memory::Memory(uint8_t *code, uint64_t len) : Memory(DRAM_BASE, MEMORY_SIZE) {
+    assert(len < MEMORY_SIZE && "Tried loading a binary that is too large");
+    std::memcpy(memory, code, len);
+}
+
+Memory* Memory::map_file(const std::string& path, uint64_t base, bool copy_on_write) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::printf("Error: Could not open %s\n", path.c_str());
+        return nullptr;
+    }
+    struct stat info{};
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        std::printf("Error: %s is empty or not a regular file\n", path.c_str());
+        close(fd);
+        return nullptr;
+    }
+    //a private writable mapping only copies the pages the guest writes to, until then it reads the page cache
+    void* mapping = copy_on_write
+            ? mmap(nullptr, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_NORESERVE, fd, 0)
+            : mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        std::printf("Error: Could not map %s\n", path.c_str());
+        return nullptr;
+    }
+    return new Memory(static_cast<std::uint8_t*>(mapping), base, info.st_size, copy_on_write);
+}
+
+Memory::~Memory() {
+    munmap(memory, m_size);
+}
+
+void Memory::discard(uint64_t addr, uint64_t len) {
+    assert(contains(addr, len) && "Error: Attempted to discard memory outside of RAM");
+    std::uint64_t offset = addr - m_base;
+    std::uint64_t first = (offset + 4095) & ~4095ull; //only whole pages can go back to the host
+    std::uint64_t last = (offset + len) & ~4095ull;
+    if (first < last)
+        madvise(memory + first, last - first, MADV_DONTNEED);
+    std::memset(memory + offset, 0, std::min(first, offset + len) - offset);
+    if (last >= first)
+        std::memset(memory + last, 0, offset + len - last);
+}
+
+//whether each page of a mapping has ever been written, from /proc/self/pagemap. a page counts if it is in RAM
+//or swapped out, pages that were never touched are neither and still read as zero.
+//false if the kernel won't say, then the caller has to look at the contents instead
+static bool touched_pages(const std::uint8_t* mapping, std::uint64_t size, std::vector<bool>& touched) {
+    int fd = open("/proc/self/pagemap", O_RDONLY);
+    if (fd < 0)
+        return false;
+    std::uint64_t first = reinterpret_cast<std::uint64_t>(mapping) / 4096;
+    std::uint64_t count = (size + 4095) / 4096;
+    std::uint64_t entries[512];
+    touched.assign(count, false);
+    for (std::uint64_t page = 0; page < count; page += 512) {
+        std::uint64_t len = std::min<std::uint64_t>(512, count - page) * 8;
+        if (pread(fd, entries, len, (off_t) ((first + page) * 8)) != (ssize_t) len) {
+            close(fd);
+            return false;
+        }
+        for (std::uint64_t i = 0; i < len / 8; i++)
+            touched[page + i] = (entries[i] & (PAGEMAP_PRESENT | PAGEMAP_SWAPPED)) != 0;
+    }
+    close(fd);
+    return true;
+}
+
+MemorySnapshot Memory::snapshot() const {
+    MemorySnapshot snapshot;
+    std::vector<bool> touched;
+    bool known = touched_pages(memory, m_size, touched);
+    for (std::uint64_t offset = 0; offset < m_size; offset += 4096) {
+        std::uint64_t len = std::min<std::uint64_t>(4096, m_size - offset);
+        //without pagemap every page is read, untouched ones just map the shared zero page
+        if (known ? !touched[offset / 4096]
+                  : std::all_of(memory + offset, memory + offset + len, [](std::uint8_t b) { return b == 0; }))
+            continue;
+        snapshot.pages.push_back(offset);
+        snapshot.data.insert(snapshot.data.end(), memory + offset, memory + offset + len);
+    }
+    return snapshot;
+}
+
+void Memory::restore(const MemorySnapshot& snapshot) {
+    discard(m_base, m_size);
+    const std::uint8_t* data = snapshot.data.data();
+    for (auto offset : snapshot.pages) {
+        std::uint64_t len = std::min<std::uint64_t>(4096, m_size - offset);
+        std::memcpy(memory + offset, data, len);
+        data += len;
+    }
+}
+
 std::uint64_t Memory::load(uint64_t addr, uint64_t size) {
-    addr = addr-DRAM_BASE;
+    addr = addr-m_base;
     switch (size) {
         case 8:
             return load8(addr);
@@ -22,7 +134,7 @@ std::uint64_t Memory::load(uint64_t addr, uint64_t size) {
 }
 
 void Memory::store(uint64_t addr, uint64_t size, uint64_t data) {
-    addr = addr-DRAM_BASE;
+    addr = addr-m_base;
     switch (size) {
         case 8:
             store8(addr,data);
@@ -8,13 +8,27 @@
 #include <cstdint>
 #include <cassert>
 #include <cstring>
+#include <string>
+#include <vector>
 
 #define DRAM_BASE 0x80000000
 #define MEMORY_SIZE (1024*1024*128) //constant for the default size of the ram (128MiB)
 
+//the contents of guest RAM at some point, see Memory::snapshot
+struct MemorySnapshot {
+    std::vector<std::uint64_t> pages; //offsets of the pages that were saved
+    std::vector<std::uint8_t> data; //their contents, one page after another
+};
+
 struct Memory {
 private:
     std::uint8_t* memory;
+    std::uint64_t m_base;
+    std::uint64_t m_size;
+    bool m_writable{true};
+
+    Memory(std::uint8_t* mapping, uint64_t base, uint64_t size, bool writable)
+            : memory(mapping), m_base(base), m_size(size), m_writable(writable) {}
 
     uint64_t load8(uint64_t);
     uint64_t load16(uint64_t);
@@ -26,17 +40,39 @@ private:
     void store32(uint64_t, uint64_t);
     void store64(uint64_t, uint64_t);
 public:
-    Memory(){
-        memory = new std::uint8_t[MEMORY_SIZE]();
+    Memory() : Memory(DRAM_BASE, MEMORY_SIZE) {}
+    Memory(uint64_t base, uint64_t size);
+    Memory(uint8_t* code, uint64_t len);
+    ~Memory();
+
+    Memory(const Memory&) = delete;
+    Memory& operator=(const Memory&) = delete;
+
+    //a host file mapped at base, straight out of the host page cache so every instance mapping it shares
+    //the same pages. read only, or copy on write so the guest's changes stay private and never reach the
+    //file. nullptr if it can't be mapped
+    static Memory* map_file(const std::string& path, uint64_t base, bool copy_on_write);
+
+    std::uint64_t base() const { return m_base; }
+    std::uint64_t size() const { return m_size; }
+    bool writable() const { return m_writable; }
+
+    bool contains(uint64_t addr, uint64_t len) const {
+        return addr >= m_base && addr - m_base <= m_size && len <= m_size - (addr - m_base);
     }
 
-    Memory(uint8_t* code, uint64_t len){
-        memory = new std::uint8_t[MEMORY_SIZE]();
-        assert(len < MEMORY_SIZE && "Tried loading a binary that is too large");
-        std::memcpy(memory, code, len);
+    //host pointer to len bytes of guest memory starting at addr, or nullptr if the range is not all RAM
+    std::uint8_t* host_pointer(uint64_t addr, uint64_t len) {
+        return contains(addr, len) ? memory + (addr - m_base) : nullptr;
     }
 
-    ~Memory() = default;
+    //zeroes a range and hands its pages back to the host
+    void discard(uint64_t, uint64_t);
+
+    //saves only the pages the guest has touched, the rest are still zero.
+    //restoring one into a Memory of the same size puts it back exactly
+    MemorySnapshot snapshot() const;
+    void restore(const MemorySnapshot&);
 
     std::uint64_t load(uint64_t, uint64_t);
     void store(uint64_t, uint64_t, uint64_t);
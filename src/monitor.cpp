@@ -0,0 +1,89 @@
+//
+// Created by John on 19/10/2026.
+//
+
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "monitor.h"
+
+//removes a segment left behind by an emulator that was killed before it could, false if the one that
+//published it is still running (or it can't be told)
+static bool reclaim(const std::string& name) {
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        return errno == ENOENT; //went away in the meantime
+    struct stat info{};
+    void* mapping = fstat(fd, &info) == 0 && info.st_size >= (off_t) sizeof(LiveStats)
+            ? mmap(nullptr, sizeof(LiveStats), PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return false;
+    auto stats = static_cast<const LiveStats*>(mapping);
+    bool stale = stats->magic.load(std::memory_order_acquire) == STATS_MAGIC && stats->publisher_gone();
+    munmap(mapping, sizeof(LiveStats));
+    return stale && (shm_unlink(name.c_str()) == 0 || errno == ENOENT);
+}
+
+StatsPublisher::StatsPublisher(const std::string& name) : m_name(segment_name(name)) {
+    //exclusive, so a second emulator given the same name can't clobber (and later unlink) the first one's segment
+    int fd = shm_open(m_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0 && errno == EEXIST && reclaim(m_name))
+        fd = shm_open(m_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        if (errno == EEXIST)
+            std::printf("Error: The stats segment %s already exists, another emulator is publishing under that "
+                        "name\n", m_name.c_str());
+        else
+            std::printf("Error: Could not create the stats segment %s\n", m_name.c_str());
+        return;
+    }
+    if (ftruncate(fd, sizeof(LiveStats)) != 0) {
+        std::printf("Error: Could not size the stats segment %s\n", m_name.c_str());
+        close(fd);
+        shm_unlink(m_name.c_str());
+        return;
+    }
+    void* mapping = mmap(nullptr, sizeof(LiveStats), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        std::printf("Error: Could not map the stats segment %s\n", m_name.c_str());
+        shm_unlink(m_name.c_str());
+        return;
+    }
+    m_stats = new (mapping) LiveStats();
+    m_stats->version = STATS_VERSION;
+    m_stats->pid = getpid();
+    m_stats->running.store(1, std::memory_order_relaxed);
+    m_last_publish = std::chrono::steady_clock::now();
+    //readers check the magic first (acquire), so they never see a half set up segment
+    m_stats->magic.store(STATS_MAGIC, std::memory_order_release);
+}
+
+StatsPublisher::~StatsPublisher() {
+    if (m_stats == nullptr)
+        return;
+    m_stats->running.store(0, std::memory_order_relaxed);
+    munmap(m_stats, sizeof(LiveStats));
+    shm_unlink(m_name.c_str()); //readers that still have it mapped can read the final numbers
+}
+
+bool StatsPublisher::due(std::uint64_t instructions, bool force) {
+    auto now = std::chrono::steady_clock::now();
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - m_last_publish).count();
+    if (elapsed < STATS_PERIOD_MS && !force)
+        return false;
+    if (elapsed > 0)
+        m_stats->instructions_per_second.store((instructions - m_last_instructions) * 1000 / elapsed,
+                                               std::memory_order_relaxed);
+    m_stats->updated_ms.store((std::uint64_t) std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count(), std::memory_order_relaxed);
+    m_last_instructions = instructions;
+    m_last_publish = now;
+    return true;
+}
@@ -0,0 +1,80 @@
+//
+// Created by John on 19/10/2026.
+//
+
+#ifndef CPPRV64_MONITOR_H
+#define CPPRV64_MONITOR_H
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <string>
+
+#define STATS_MAGIC 0x5441545334365652 //"RV64STAT"
+#define STATS_VERSION 1
+#define STATS_CAUSES 16 //exception and interrupt codes counted, anything higher is counted as the last one
+#define STATS_PERIOD_MS 100 //how often the hart publishes
+
+// What a running emulator publishes about itself, laid out in a named shared memory segment so a
+// monitor in another process (see rv64stat.cpp) can read it at any time. The hart keeps its own
+// counters and copies them in here every STATS_PERIOD_MS with relaxed stores, so the guest never
+// waits on a reader and readers never see torn values, just slightly stale ones.
+struct LiveStats {
+    std::atomic<std::uint64_t> magic; //set last, with release
+    std::uint64_t version;
+    std::uint64_t pid;
+    std::atomic<std::uint64_t> running; //cleared when the emulator exits
+
+    std::atomic<std::uint64_t> updated_ms; //since the epoch
+    std::atomic<std::uint64_t> instructions; //retired
+    std::atomic<std::uint64_t> instructions_per_second; //over the last period
+    std::atomic<std::uint64_t> mode_instructions[4]; //retired in each privilege mode, by its encoding (U=0, S=1, M=3)
+    std::atomic<std::uint64_t> exceptions[STATS_CAUSES]; //by cause
+    std::atomic<std::uint64_t> interrupts[STATS_CAUSES];
+
+    //the block cache (see tiers.h)
+    std::atomic<std::uint64_t> cached_blocks;
+    std::atomic<std::uint64_t> interpreted_blocks;
+    std::atomic<std::uint64_t> promotions;
+    std::atomic<std::uint64_t> flushes;
+
+    //the console (see uart.h)
+    std::atomic<std::uint64_t> uart_received; //bytes the guest read
+    std::atomic<std::uint64_t> uart_sent; //bytes the guest wrote
+    std::atomic<std::uint64_t> uart_dropped; //written with the transmit ring full
+
+    std::atomic<std::uint64_t> syscalls; //user mode only
+
+    //whether the emulator that published this has died, one that was killed never got to clear running
+    bool publisher_gone() const { return kill((pid_t) pid, 0) != 0 && errno == ESRCH; }
+};
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "shared stats need lock free atomics");
+
+//the emulator's side: creates the segment and removes it again on exit
+class StatsPublisher {
+private:
+    std::string m_name;
+    LiveStats* m_stats{};
+    std::uint64_t m_last_instructions{};
+    std::chrono::steady_clock::time_point m_last_publish;
+public:
+    //name is the shm_open name, "/" is added to the front if it's missing
+    explicit StatsPublisher(const std::string& name);
+    ~StatsPublisher();
+
+    StatsPublisher(const StatsPublisher&) = delete;
+    StatsPublisher& operator=(const StatsPublisher&) = delete;
+
+    bool ok() const { return m_stats != nullptr; }
+    LiveStats& stats() { return *m_stats; }
+
+    //whether a period has gone by since the last publish, also works out the instruction rate over it
+    bool due(std::uint64_t instructions, bool force);
+
+    static std::string segment_name(const std::string& name) { return name.rfind('/', 0) == 0 ? name : "/" + name; }
+};
+
+#endif //CPPRV64_MONITOR_H
@@ -0,0 +1,540 @@
+//
+// Created by John on 19/10/2026.
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <ctime>
+#include <elf.h>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "process.h"
+
+//RV64 Linux syscall numbers (asm-generic), these don't match the host's on x86_64
+enum Syscall : std::uint64_t {
+    Ioctl = 29,
+    Openat = 56,
+    Close = 57,
+    Lseek = 62,
+    Read = 63,
+    Write = 64,
+    Writev = 66,
+    Newfstatat = 79,
+    Fstat = 80,
+    Exit = 93,
+    ExitGroup = 94,
+    SetTidAddress = 96,
+    SetRobustList = 99,
+    ClockGettime = 113,
+    RtSigaction = 134,
+    RtSigprocmask = 135,
+    Getpid = 172,
+    Gettid = 178,
+    Brk = 214,
+    Munmap = 215,
+    Mmap = 222,
+    Mprotect = 226,
+    Getrandom = 278,
+};
+
+//struct stat as the RV64 kernel lays it out
+struct GuestStat {
+    std::uint64_t dev;
+    std::uint64_t ino;
+    std::uint32_t mode;
+    std::uint32_t nlink;
+    std::uint32_t uid;
+    std::uint32_t gid;
+    std::uint64_t rdev;
+    std::uint64_t pad1;
+    std::int64_t size;
+    std::int32_t blksize;
+    std::int32_t pad2;
+    std::int64_t blocks;
+    std::int64_t atime;
+    std::uint64_t atime_nsec;
+    std::int64_t mtime;
+    std::uint64_t mtime_nsec;
+    std::int64_t ctime;
+    std::uint64_t ctime_nsec;
+    std::uint32_t unused[2];
+};
+static_assert(sizeof(GuestStat) == 128, "GuestStat must match the RV64 struct stat");
+
+static std::uint64_t page_align(std::uint64_t addr) {
+    return (addr + GUEST_PAGE_SIZE - 1) & ~(std::uint64_t) (GUEST_PAGE_SIZE - 1);
+}
+
+//host syscalls report failure through errno, the guest expects -errno in a0
+static std::int64_t result(std::int64_t ret) {
+    return ret < 0 ? -errno : ret;
+}
+
+//a NUL terminated string in guest memory (RAM or a mapped file), or nullptr if it runs off the end of it
+static const char* guest_string(Bus& bus, std::uint64_t addr) {
+    auto start = bus.readable_pointer(addr, 1);
+    if (start == nullptr)
+        return nullptr;
+    Memory* region = bus.region(addr, 1);
+    std::uint64_t limit = region->base() + region->size() - addr;
+    return std::memchr(start, 0, limit) != nullptr ? reinterpret_cast<const char*>(start) : nullptr;
+}
+
+bool Process::load(Bus& bus, const std::string& filename, const std::vector<std::string>& args,
+                   const std::vector<std::string>& env, std::uint64_t& entry, std::uint64_t& sp) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) {
+        std::fprintf(stderr, "Error: File Not Found\n");
+        return false;
+    }
+    std::vector<char> image((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    auto ehdr = reinterpret_cast<const Elf64_Ehdr*>(image.data());
+    if (image.size() < sizeof(Elf64_Ehdr) || std::memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0
+        || ehdr->e_ident[EI_CLASS] != ELFCLASS64 || ehdr->e_machine != EM_RISCV) {
+        std::fprintf(stderr, "Error: %s is not a RV64 ELF\n", filename.c_str());
+        return false;
+    }
+    if (ehdr->e_type != ET_EXEC || ehdr->e_phoff + ehdr->e_phnum * sizeof(Elf64_Phdr) > image.size()) {
+        std::fprintf(stderr, "Error: %s is not a statically linked executable\n", filename.c_str());
+        return false;
+    }
+
+    auto phdrs = reinterpret_cast<const Elf64_Phdr*>(image.data() + ehdr->e_phoff);
+    std::uint64_t phdr_addr = 0, end = 0;
+    for (int i = 0; i < ehdr->e_phnum; i++) {
+        const Elf64_Phdr& phdr = phdrs[i];
+        if (phdr.p_type == PT_INTERP) {
+            std::fprintf(stderr, "Error: %s is dynamically linked\n", filename.c_str());
+            return false;
+        }
+        if (phdr.p_type == PT_PHDR)
+            phdr_addr = phdr.p_vaddr;
+        if (phdr.p_type != PT_LOAD)
+            continue;
+
+        auto dest = bus.host_pointer(phdr.p_vaddr, phdr.p_memsz);
+        if (dest == nullptr || phdr.p_filesz > phdr.p_memsz || phdr.p_offset + phdr.p_filesz > image.size()) {
+            std::fprintf(stderr, "Error: Segment at 0x%lX does not fit in guest memory\n", phdr.p_vaddr);
+            return false;
+        }
+        std::memcpy(dest, image.data() + phdr.p_offset, phdr.p_filesz);
+
+        if (phdr_addr == 0 && ehdr->e_phoff >= phdr.p_offset && ehdr->e_phoff < phdr.p_offset + phdr.p_filesz)
+            phdr_addr = phdr.p_vaddr + (ehdr->e_phoff - phdr.p_offset);
+        end = std::max(end, phdr.p_vaddr + phdr.p_memsz);
+    }
+
+    //function symbols are kept so host code can recognise well known routines in the guest
+    auto shdrs = reinterpret_cast<const Elf64_Shdr*>(image.data() + ehdr->e_shoff);
+    if (ehdr->e_shoff != 0 && ehdr->e_shoff + ehdr->e_shnum * sizeof(Elf64_Shdr) <= image.size()) {
+        for (int i = 0; i < ehdr->e_shnum; i++) {
+            const Elf64_Shdr& symtab = shdrs[i];
+            if (symtab.sh_type != SHT_SYMTAB || symtab.sh_link >= ehdr->e_shnum
+                || symtab.sh_offset + symtab.sh_size > image.size())
+                continue;
+            const Elf64_Shdr& strtab = shdrs[symtab.sh_link];
+            auto syms = reinterpret_cast<const Elf64_Sym*>(image.data() + symtab.sh_offset);
+            for (std::uint64_t j = 0; j < symtab.sh_size / sizeof(Elf64_Sym); j++) {
+                if (ELF64_ST_TYPE(syms[j].st_info) != STT_FUNC || syms[j].st_value == 0
+                    || syms[j].st_name >= strtab.sh_size || strtab.sh_offset + strtab.sh_size > image.size())
+                    continue;
+                const char* name = image.data() + strtab.sh_offset + syms[j].st_name;
+                m_symbols.push_back({std::string(name, strnlen(name, strtab.sh_size - syms[j].st_name)),
+                                     syms[j].st_value, syms[j].st_size});
+            }
+        }
+    }
+
+    Memory& ram = bus.dram();
+    std::uint64_t top = ram.base() + ram.size();
+    m_brk_start = m_brk = page_align(end);
+    m_mmap_floor = top - USER_STACK_SIZE;
+
+    //strings go at the very top, followed by the argv/envp/auxv vectors the C runtime starts from
+    sp = top;
+    auto push = [&](const void* data, std::uint64_t len) {
+        sp -= len;
+        std::memcpy(bus.host_pointer(sp, len), data, len);
+        return sp;
+    };
+    std::vector<std::uint64_t> arg_ptrs, env_ptrs;
+    for (auto& arg : args)
+        arg_ptrs.push_back(push(arg.c_str(), arg.size() + 1));
+    for (auto& var : env)
+        env_ptrs.push_back(push(var.c_str(), var.size() + 1));
+    std::uint8_t random_bytes[16];
+    if (getrandom(random_bytes, sizeof(random_bytes), 0) != sizeof(random_bytes))
+        std::memset(random_bytes, 0x5a, sizeof(random_bytes));
+    std::uint64_t random_addr = push(random_bytes, sizeof(random_bytes));
+
+    std::vector<std::uint64_t> words;
+    words.push_back(args.size());
+    words.insert(words.end(), arg_ptrs.begin(), arg_ptrs.end());
+    words.push_back(0);
+    words.insert(words.end(), env_ptrs.begin(), env_ptrs.end());
+    words.push_back(0);
+    std::uint64_t auxv[][2] = {
+            {AT_PHDR, phdr_addr}, {AT_PHENT, sizeof(Elf64_Phdr)}, {AT_PHNUM, ehdr->e_phnum},
+            {AT_PAGESZ, GUEST_PAGE_SIZE}, {AT_ENTRY, ehdr->e_entry}, {AT_UID, getuid()}, {AT_EUID, geteuid()},
+            {AT_GID, getgid()}, {AT_EGID, getegid()}, {AT_CLKTCK, 100}, {AT_RANDOM, random_addr}, {AT_NULL, 0},
+    };
+    for (auto& pair : auxv) {
+        words.push_back(pair[0]);
+        words.push_back(pair[1]);
+    }
+
+    sp = (sp - words.size() * 8) & ~15ull; //the ABI wants sp 16 byte aligned on entry
+    std::memcpy(bus.host_pointer(sp, words.size() * 8), words.data(), words.size() * 8);
+
+    entry = ehdr->e_entry;
+    return true;
+}
+
+bool Process::syscall(std::uint64_t* registers, Bus& bus) {
+    std::uint64_t a0 = registers[10], a1 = registers[11], a2 = registers[12],
+                  a3 = registers[13], a4 = registers[14], a5 = registers[15];
+    std::uint8_t* buffer;
+    std::int64_t ret;
+    m_syscalls++;
+
+    switch (registers[17]) {
+        case Read:
+            buffer = bus.host_pointer(a1, a2);
+            if (buffer == nullptr) {
+                ret = -EFAULT;
+            } else if (m_sandboxed && a0 == STDIN_FILENO) {
+                ret = 0;
+            } else if (m_sandboxed && m_files.count((int) a0) != 0) {
+                GuestFile& file = m_files.at((int) a0);
+                ret = result(::pread(file.fd, buffer, a2, file.offset));
+                if (ret > 0)
+                    file.offset += ret;
+            } else {
+                ret = result(::read(host_fd((int) a0), buffer, a2));
+            }
+            break;
+        case Write: {
+            auto data = bus.readable_pointer(a1, a2); //straight out of a read only file is fine too
+            if (m_sandboxed)
+                ret = data != nullptr ? (std::int64_t) a2 : -EFAULT;
+            else
+                ret = data != nullptr ? result(::write((int) a0, data, a2)) : -EFAULT;
+            break;
+        }
+        case Writev: {
+            if (a2 > IOV_MAX) {
+                ret = -EINVAL;
+                break;
+            }
+            auto guest_iov = reinterpret_cast<const std::uint64_t*>(bus.readable_pointer(a1, a2 * 16));
+            std::vector<iovec> iov(a2);
+            ret = guest_iov != nullptr ? 0 : -EFAULT;
+            for (std::uint64_t i = 0; ret == 0 && i < a2; i++) {
+                auto data = bus.readable_pointer(guest_iov[2 * i], guest_iov[2 * i + 1]);
+                iov[i].iov_base = const_cast<std::uint8_t*>(data); //writev only reads through it
+                iov[i].iov_len = guest_iov[2 * i + 1];
+                if (iov[i].iov_base == nullptr)
+                    ret = -EFAULT;
+            }
+            for (std::uint64_t i = 0; ret >= 0 && m_sandboxed && i < a2; i++)
+                ret += (std::int64_t) iov[i].iov_len;
+            if (ret == 0 && !m_sandboxed)
+                ret = result(::writev((int) a0, iov.data(), (int) a2));
+            break;
+        }
+        case Openat: {
+            const char* path = guest_string(bus, a1);
+            ret = path != nullptr ? open(host_fd((int) a0), path, (int) a2, (mode_t) a3) : -EFAULT;
+            break;
+        }
+        case Close:
+            ret = close((int) a0);
+            break;
+        case Lseek:
+            ret = lseek((int) a0, (std::int64_t) a1, (int) a2);
+            break;
+        case Fstat:
+            ret = fstat(bus, host_fd((int) a0), nullptr, a1, 0);
+            break;
+        case Newfstatat: {
+            const char* path = guest_string(bus, a1);
+            ret = path != nullptr ? fstat(bus, host_fd((int) a0), path, a2, (int) a3) : -EFAULT;
+            break;
+        }
+        case Brk:
+            ret = brk(bus, a0);
+            break;
+        case Mmap:
+            ret = mmap(bus, a0, a1, a2, a3, a4, a5);
+            break;
+        case Munmap:
+            ret = munmap(bus, a0, a1);
+            break;
+        case ClockGettime: {
+            timespec ts{};
+            buffer = bus.host_pointer(a1, 16);
+            ret = buffer != nullptr ? result(::clock_gettime((clockid_t) a0, &ts)) : -EFAULT;
+            if (ret == 0) {
+                std::int64_t guest_ts[2] = {ts.tv_sec, ts.tv_nsec};
+                std::memcpy(buffer, guest_ts, sizeof(guest_ts));
+            }
+            break;
+        }
+        case Getrandom:
+            buffer = bus.host_pointer(a0, a1);
+            ret = buffer != nullptr ? result(::getrandom(buffer, a1, (unsigned int) a2)) : -EFAULT;
+            break;
+        case Exit:
+        case ExitGroup:
+            m_exited = true;
+            m_exit_code = (int) (a0 & 0xff);
+            ret = 0;
+            break;
+        case Ioctl:
+            ret = -ENOTTY; //no terminals in here
+            break;
+        case Getpid:
+        case Gettid:
+        case SetTidAddress:
+            ret = ::getpid();
+            break;
+        case SetRobustList:
+        case RtSigaction:
+        case RtSigprocmask:
+        case Mprotect:
+            ret = 0; //single threaded, no signals and no page protection, so these can only succeed
+            break;
+        default:
+            std::fprintf(stderr, "WARNING: Unimplemented syscall %ld\n", registers[17]);
+            ret = -ENOSYS;
+            break;
+    }
+    registers[10] = ret;
+    return registers[17] == Mmap || registers[17] == Munmap || registers[17] == Brk;
+}
+
+GuestFile::GuestFile(const GuestFile& other) : fd(::fcntl(other.fd, F_DUPFD_CLOEXEC, 0)), offset(other.offset) {}
+
+GuestFile& GuestFile::operator=(const GuestFile& other) {
+    if (this != &other) {
+        if (fd >= 0)
+            ::close(fd);
+        fd = ::fcntl(other.fd, F_DUPFD_CLOEXEC, 0);
+        offset = other.offset;
+    }
+    return *this;
+}
+
+GuestFile& GuestFile::operator=(GuestFile&& other) noexcept {
+    if (this != &other) {
+        if (fd >= 0)
+            ::close(fd);
+        fd = other.fd;
+        offset = other.offset;
+        other.fd = -1;
+    }
+    return *this;
+}
+
+GuestFile::~GuestFile() {
+    if (fd >= 0)
+        ::close(fd);
+}
+
+//the host fd behind a guest one. outside the sandbox they're the same, inside it only stdio and AT_FDCWD
+//pass through and anything else the guest didn't open itself is -1, which the host rejects with EBADF
+int Process::host_fd(int fd) const {
+    if (!m_sandboxed || fd <= STDERR_FILENO)
+        return fd;
+    auto it = m_files.find(fd);
+    return it != m_files.end() ? it->second.fd : -1;
+}
+
+std::int64_t Process::open(int dirfd, const char* path, int flags, mode_t mode) {
+    if (!m_sandboxed)
+        return result(::openat(dirfd, path, flags, mode));
+    //the real run may have written this file already, a replay must leave it as it is
+    if ((flags & O_ACCMODE) != O_RDONLY || (flags & (O_CREAT | O_TRUNC)) != 0)
+        return -EACCES;
+    int fd = ::openat(dirfd, path, flags | O_CLOEXEC);
+    if (fd < 0)
+        return -errno;
+    int guest = STDERR_FILENO + 1; //lowest free, like the kernel, so every replay numbers its files the same
+    while (m_files.count(guest) != 0)
+        guest++;
+    m_files.emplace(guest, GuestFile(fd, 0));
+    return guest;
+}
+
+std::int64_t Process::close(int fd) {
+    //keep the emulator's own stdio alive even if the guest closes its copies
+    if (fd >= 0 && fd <= STDERR_FILENO)
+        return 0;
+    if (!m_sandboxed)
+        return result(::close(fd));
+    return m_files.erase(fd) != 0 ? 0 : -EBADF;
+}
+
+std::int64_t Process::lseek(int fd, std::int64_t offset, int whence) {
+    if (!m_sandboxed)
+        return result(::lseek(fd, (off_t) offset, whence));
+    auto it = m_files.find(fd);
+    if (it == m_files.end())
+        return fd >= 0 && fd <= STDERR_FILENO ? -ESPIPE : -EBADF;
+
+    GuestFile& file = it->second;
+    std::int64_t base;
+    struct stat st{};
+    switch (whence) {
+        case SEEK_SET:
+            base = 0;
+            break;
+        case SEEK_CUR:
+            base = file.offset;
+            break;
+        case SEEK_END:
+            if (::fstat(file.fd, &st) != 0)
+                return -errno;
+            base = st.st_size;
+            break;
+        default:
+            return -EINVAL;
+    }
+    if (base + offset < 0)
+        return -EINVAL;
+    file.offset = base + offset;
+    return file.offset;
+}
+
+std::int64_t Process::fstat(Bus& bus, int fd, const char* path, std::uint64_t addr, int flags) {
+    struct stat st{};
+    auto buffer = bus.host_pointer(addr, sizeof(GuestStat));
+    if (buffer == nullptr)
+        return -EFAULT;
+    std::int64_t ret = result(path == nullptr ? ::fstat(fd, &st) : ::fstatat(fd, path, &st, flags));
+    if (ret != 0)
+        return ret;
+
+    GuestStat guest{};
+    guest.dev = st.st_dev;
+    guest.ino = st.st_ino;
+    guest.mode = st.st_mode;
+    guest.nlink = st.st_nlink;
+    guest.uid = st.st_uid;
+    guest.gid = st.st_gid;
+    guest.rdev = st.st_rdev;
+    guest.size = st.st_size;
+    guest.blksize = (std::int32_t) st.st_blksize;
+    guest.blocks = st.st_blocks;
+    guest.atime = st.st_atim.tv_sec;
+    guest.atime_nsec = st.st_atim.tv_nsec;
+    guest.mtime = st.st_mtim.tv_sec;
+    guest.mtime_nsec = st.st_mtim.tv_nsec;
+    guest.ctime = st.st_ctim.tv_sec;
+    guest.ctime_nsec = st.st_ctim.tv_nsec;
+    std::memcpy(buffer, &guest, sizeof(guest));
+    return 0;
+}
+
+std::int64_t Process::brk(Bus& bus, std::uint64_t addr) {
+    if (addr < m_brk_start || addr > m_mmap_floor)
+        return m_brk; //the kernel reports the unchanged break rather than an error
+    if (page_align(addr) < page_align(m_brk))
+        bus.dram().discard(page_align(addr), page_align(m_brk) - page_align(addr));
+    m_brk = addr;
+    return m_brk;
+}
+
+std::int64_t Process::mmap(Bus& bus, std::uint64_t addr, std::uint64_t len, std::uint64_t,
+                           std::uint64_t flags, std::uint64_t fd, std::uint64_t offset) {
+    if (len == 0)
+        return -EINVAL;
+    len = page_align(len);
+
+    std::uint64_t target = 0;
+    if (flags & MAP_FIXED) {
+        if (addr % GUEST_PAGE_SIZE != 0 || bus.host_pointer(addr, len) == nullptr || addr < m_brk)
+            return -EINVAL;
+        bus.dram().discard(addr, len); //replaces whatever was mapped there before
+        reserve(addr, len);
+        target = addr;
+    } else {
+        for (auto it = m_free_maps.begin(); it != m_free_maps.end(); ++it) {
+            if (it->second >= len) {
+                target = it->first;
+                if (it->second > len)
+                    m_free_maps[target + len] = it->second - len;
+                m_free_maps.erase(it);
+                break;
+            }
+        }
+        if (target == 0) {
+            if (m_mmap_floor - m_brk < len)
+                return -ENOMEM;
+            m_mmap_floor -= len;
+            target = m_mmap_floor;
+        }
+    }
+
+    if (!(flags & MAP_ANONYMOUS)) {
+        //file mappings are private copies, writes never reach the file
+        std::int64_t ret = result(::pread(host_fd((int) fd), bus.host_pointer(target, len), len, (off_t) offset));
+        if (ret < 0) {
+            munmap(bus, target, len);
+            return ret;
+        }
+    }
+    return (std::int64_t) target;
+}
+
+std::int64_t Process::munmap(Bus& bus, std::uint64_t addr, std::uint64_t len) {
+    len = page_align(len);
+    if (addr % GUEST_PAGE_SIZE != 0 || bus.host_pointer(addr, len) == nullptr)
+        return -EINVAL;
+    bus.dram().discard(addr, len);
+
+    //only the mmap area is recycled, and freed ranges are merged with their neighbours
+    std::uint64_t stack_bottom = bus.dram().base() + bus.dram().size() - USER_STACK_SIZE;
+    if (addr < m_mmap_floor || addr + len > stack_bottom)
+        return 0;
+    reserve(addr, len);
+    auto it = m_free_maps.emplace(addr, len).first;
+    auto next = std::next(it);
+    if (next != m_free_maps.end() && it->first + it->second == next->first) {
+        it->second += next->second;
+        m_free_maps.erase(next);
+    }
+    if (it != m_free_maps.begin()) {
+        auto prev = std::prev(it);
+        if (prev->first + prev->second == it->first) {
+            prev->second += it->second;
+            m_free_maps.erase(it);
+        }
+    }
+    return 0;
+}
+
+void Process::reserve(std::uint64_t addr, std::uint64_t len) {
+    //cut [addr, addr+len) out of any free ranges that overlap it
+    auto it = m_free_maps.lower_bound(addr);
+    if (it != m_free_maps.begin() && std::prev(it)->first + std::prev(it)->second > addr)
+        --it;
+    while (it != m_free_maps.end() && it->first < addr + len) {
+        std::uint64_t start = it->first, end = it->first + it->second;
+        it = m_free_maps.erase(it);
+        if (start < addr)
+            m_free_maps[start] = addr - start;
+        if (end > addr + len)
+            m_free_maps[addr + len] = end - (addr + len);
+    }
+}
@@ -0,0 +1,89 @@
+//
+// Created by John on 19/10/2026.
+//
+
+#ifndef CPPRV64_PROCESS_H
+#define CPPRV64_PROCESS_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+#include "bus.h"
+
+#define USER_MEMORY_BASE ((std::uint64_t) 0x0)
+#define USER_MEMORY_SIZE (1024ull*1024*1024) //guest address space for user-mode programs (1GiB), backed lazily
+#define USER_STACK_SIZE (1024*1024*8) //space reserved below the top of memory for the initial stack (8MiB)
+#define GUEST_PAGE_SIZE 4096
+
+//a function from the program's symbol table
+struct Symbol {
+    std::string name;
+    std::uint64_t addr;
+    std::uint64_t size;
+};
+
+//a file the guest opened while sandboxed, read with pread so the offset belongs to the guest rather than the
+//host fd. copies get a dup of their own, so every copy of the process can close its files independently
+struct GuestFile {
+    int fd{-1};
+    std::int64_t offset{};
+
+    GuestFile(int fd, std::int64_t offset) : fd(fd), offset(offset) {}
+    GuestFile(const GuestFile&);
+    GuestFile(GuestFile&& other) noexcept : fd(other.fd), offset(other.offset) { other.fd = -1; }
+    GuestFile& operator=(const GuestFile&);
+    GuestFile& operator=(GuestFile&&) noexcept;
+    ~GuestFile();
+};
+
+// Stands in for the Linux kernel when running a statically linked RV64 program in user mode:
+// the ELF is loaded straight into guest memory and each ecall from U-mode is serviced by the host.
+// Guest buffers are handed to the host syscalls as pointers into guest RAM, nothing is copied.
+struct Process {
+private:
+    std::uint64_t m_brk_start{};
+    std::uint64_t m_brk{};
+    std::uint64_t m_mmap_floor{}; //anonymous mappings grow down from the bottom of the stack
+    std::map<std::uint64_t, std::uint64_t> m_free_maps; //unmapped ranges available for reuse, addr -> length
+    std::vector<Symbol> m_symbols;
+
+    bool m_exited{};
+    int m_exit_code{};
+    bool m_sandboxed{};
+    std::map<int, GuestFile> m_files; //sandboxed only, guest fd -> host file
+    std::uint64_t m_syscalls{};
+
+    std::int64_t brk(Bus&, std::uint64_t);
+    std::int64_t mmap(Bus&, std::uint64_t, std::uint64_t, std::uint64_t, std::uint64_t, std::uint64_t, std::uint64_t);
+    std::int64_t munmap(Bus&, std::uint64_t, std::uint64_t);
+    void reserve(std::uint64_t, std::uint64_t);
+    std::int64_t fstat(Bus&, int, const char*, std::uint64_t, int);
+    int host_fd(int) const;
+    std::int64_t open(int, const char*, int, mode_t);
+    std::int64_t close(int);
+    std::int64_t lseek(int, std::int64_t, int);
+public:
+    //loads the ELF and builds the initial stack, returns false (after printing why) if the program can't run
+    bool load(Bus&, const std::string&, const std::vector<std::string>&, const std::vector<std::string>&,
+              std::uint64_t& entry, std::uint64_t& sp);
+
+    //services the syscall number in a7 with arguments in a0-a5, the result is written back to a0.
+    //returns true if the call replaced memory the guest may already have run code from
+    bool syscall(std::uint64_t* registers, Bus&);
+
+    //for re-running part of a program that already ran for real: its writes are dropped (but reported as
+    //done) and stdin reads as empty, so it can't repeat output or wait on input. files can only be opened
+    //for reading, and the fds stay private to this process so replays running side by side can't disturb
+    //each other's offsets
+    void sandbox() { m_sandboxed = true; }
+
+    const std::vector<Symbol>& symbols() const { return m_symbols; }
+    std::uint64_t syscalls() const { return m_syscalls; }
+    bool exited() const { return m_exited; }
+    int exit_code() const { return m_exit_code; }
+};
+
+#endif //CPPRV64_PROCESS_H
@@ -0,0 +1,65 @@
+//
+// Created by John on 19/10/2026.
+//
+
+#ifndef CPPRV64_RING_H
+#define CPPRV64_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// A fixed size single-producer/single-consumer queue. One thread only ever pushes and one
+// other thread only ever pops, so neither side needs a lock: each index is written by one side
+// and read by the other. Size has to be a power of two.
+template<class T, std::size_t Size>
+class Ring {
+private:
+    static_assert((Size & (Size - 1)) == 0, "ring size must be a power of two");
+
+    //kept on separate cache lines so the two threads don't fight over them
+    alignas(64) std::atomic<std::size_t> m_head{}; //next slot to pop, written by the consumer
+    alignas(64) std::atomic<std::size_t> m_tail{}; //next slot to push, written by the producer
+    alignas(64) T m_slots[Size];
+public:
+    //producer side, false if the ring is full
+    bool push(const T& value) {
+        std::size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) == Size)
+            return false;
+        m_slots[tail & (Size - 1)] = value;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    //consumer side, false if the ring is empty
+    bool pop(T& value) {
+        std::size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire))
+            return false;
+        value = m_slots[head & (Size - 1)];
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    //consumer side, copies out up to len values and returns how many
+    std::size_t pop(T* values, std::size_t len) {
+        std::size_t head = m_head.load(std::memory_order_relaxed);
+        std::size_t count = m_tail.load(std::memory_order_acquire) - head;
+        if (count > len)
+            count = len;
+        for (std::size_t i = 0; i < count; i++)
+            values[i] = m_slots[(head + i) & (Size - 1)];
+        m_head.store(head + count, std::memory_order_release);
+        return count;
+    }
+
+    //either side can ask, the answer may be stale by the time it's used
+    bool empty() const { return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire); }
+    bool full() const { return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire) == Size; }
+    std::size_t space() const {
+        return Size - (m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire));
+    }
+};
+
+#endif //CPPRV64_RING_H
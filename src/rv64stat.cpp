@@ -0,0 +1,85 @@
+//
+// Created by John on 19/10/2026.
+//
+// Samples the statistics a running cppRV64 publishes with --monitor <name>, without stopping it.
+// usage: rv64stat <name> [period ms]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+
+#include "monitor.h"
+
+static double percent(std::uint64_t part, std::uint64_t whole) {
+    return whole != 0 ? 100.0 * (double) part / (double) whole : 0.0;
+}
+
+static void print(const LiveStats& stats) {
+    constexpr auto relaxed = std::memory_order_relaxed;
+    std::uint64_t instructions = stats.instructions.load(relaxed);
+    std::uint64_t cached = stats.cached_blocks.load(relaxed);
+    std::uint64_t blocks = cached + stats.interpreted_blocks.load(relaxed);
+    std::uint64_t exceptions = 0, interrupts = 0;
+    for (int i = 0; i < STATS_CAUSES; i++) {
+        exceptions += stats.exceptions[i].load(relaxed);
+        interrupts += stats.interrupts[i].load(relaxed);
+    }
+    std::printf("%14lu %9.2f %5.1f %5.1f %5.1f %7.2f%% %9lu %9lu %9lu %10lu %10lu %6lu %9lu\n",
+                instructions, (double) stats.instructions_per_second.load(relaxed) / 1e6,
+                percent(stats.mode_instructions[0].load(relaxed), instructions),
+                percent(stats.mode_instructions[1].load(relaxed), instructions),
+                percent(stats.mode_instructions[3].load(relaxed), instructions),
+                percent(cached, blocks), stats.flushes.load(relaxed), exceptions, interrupts,
+                stats.uart_received.load(relaxed), stats.uart_sent.load(relaxed), stats.uart_dropped.load(relaxed),
+                stats.syscalls.load(relaxed));
+    for (int i = 0; i < STATS_CAUSES; i++) {
+        if (stats.exceptions[i].load(relaxed) != 0)
+            std::printf("    exception %2d: %lu\n", i, stats.exceptions[i].load(relaxed));
+        if (stats.interrupts[i].load(relaxed) != 0)
+            std::printf("    interrupt %2d: %lu\n", i, stats.interrupts[i].load(relaxed));
+    }
+    std::fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::printf("usage: %s <name> [period ms]\n", argv[0]);
+        return 1;
+    }
+    std::string name = StatsPublisher::segment_name(argv[1]);
+    long period = argc > 2 ? std::strtol(argv[2], nullptr, 10) : 1000;
+
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        std::printf("Error: No emulator is publishing %s\n", name.c_str());
+        return 1;
+    }
+    void* mapping = mmap(nullptr, sizeof(LiveStats), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        std::printf("Error: Could not map %s\n", name.c_str());
+        return 1;
+    }
+    auto stats = static_cast<const LiveStats*>(mapping);
+    if (stats->magic.load(std::memory_order_acquire) != STATS_MAGIC || stats->version != STATS_VERSION) {
+        std::printf("Error: %s isn't a cppRV64 stats segment this version understands\n", name.c_str());
+        return 1;
+    }
+
+    std::printf("pid %lu\n", stats->pid);
+    std::printf("%14s %9s %5s %5s %5s %8s %9s %9s %9s %10s %10s %6s %9s\n", "instructions", "MIPS", "U%", "S%", "M%",
+                "cached", "flushes", "traps", "irqs", "uart in", "uart out", "drops", "syscalls");
+    while (stats->running.load(std::memory_order_relaxed) && !stats->publisher_gone()) {
+        print(*stats);
+        std::this_thread::sleep_for(std::chrono::milliseconds(period));
+    }
+    print(*stats); //the final numbers
+    if (stats->running.load(std::memory_order_relaxed))
+        std::printf("(the emulator was killed, these are the last numbers it published)\n");
+    munmap(mapping, sizeof(LiveStats));
+    return 0;
+}
@@ -0,0 +1,278 @@
+//
+// Created by John on 19/10/2026.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <random>
+#include <thread>
+
+#include "sampler.h"
+
+static std::uint64_t milliseconds_since(std::chrono::steady_clock::time_point start) {
+    return (std::uint64_t) std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count();
+}
+
+//a fixed pseudo random weight in [-1, 1] for each block and dimension, the same every run
+static double projection(std::uint64_t pc, std::uint64_t dimension) {
+    std::uint64_t x = pc * BBV_DIMENSIONS + dimension + 0x9e3779b97f4a7c15;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+    x ^= x >> 31;
+    return (double) (x >> 11) / (double) (1ull << 52) - 1.0;
+}
+
+static double distance(const std::vector<double>& a, const std::vector<double>& b) {
+    double sum = 0;
+    for (std::uint64_t i = 0; i < a.size(); i++)
+        sum += (a[i] - b[i]) * (a[i] - b[i]);
+    return sum;
+}
+
+Sampler::Sampler(std::uint64_t interval, std::uint32_t clusters, std::uint32_t threads)
+        : m_interval(interval), m_clusters(clusters),
+          m_threads(threads != 0 ? threads : std::max(1u, std::thread::hardware_concurrency())) {}
+
+//normalised so intervals of different lengths (the last one) still compare by where their time went
+void Sampler::project(const BbvProfile& profile, std::uint64_t instructions) {
+    std::vector<double> vector(BBV_DIMENSIONS);
+    for (auto& [pc, count] : profile.counts) {
+        double share = (double) count / (double) instructions;
+        for (std::uint64_t d = 0; d < BBV_DIMENSIONS; d++)
+            vector[d] += share * projection(pc, d);
+    }
+    m_vectors.push_back(std::move(vector));
+}
+
+//k-means over the interval vectors with k clusters (fewer if there aren't that many distinct intervals)
+void Sampler::kmeans(std::uint64_t k, std::vector<std::uint32_t>& assignment,
+                     std::vector<std::vector<double>>& centres) const {
+    std::mt19937_64 random(1); //fixed, so the same run always picks the same samples
+
+    //k-means++ seeding: each next centre is likely to be far from the ones already picked
+    centres = {m_vectors[random() % m_vectors.size()]};
+    std::vector<double> nearest(m_vectors.size(), std::numeric_limits<double>::max());
+    while (centres.size() < k) {
+        double total = 0;
+        for (std::uint64_t i = 0; i < m_vectors.size(); i++) {
+            nearest[i] = std::min(nearest[i], distance(m_vectors[i], centres.back()));
+            total += nearest[i];
+        }
+        if (total == 0) //fewer distinct intervals than clusters
+            break;
+        double target = std::uniform_real_distribution<double>(0, total)(random);
+        std::uint64_t pick = 0;
+        for (; pick + 1 < m_vectors.size() && target >= nearest[pick]; pick++)
+            target -= nearest[pick];
+        centres.push_back(m_vectors[pick]);
+    }
+
+    assignment.assign(m_vectors.size(), 0);
+    for (std::uint32_t iteration = 0; iteration < KMEANS_ITERATIONS; iteration++) {
+        bool changed = false;
+        for (std::uint64_t i = 0; i < m_vectors.size(); i++) {
+            std::uint32_t best = 0;
+            for (std::uint32_t c = 1; c < centres.size(); c++) {
+                if (distance(m_vectors[i], centres[c]) < distance(m_vectors[i], centres[best]))
+                    best = c;
+            }
+            changed |= iteration == 0 || assignment[i] != best;
+            assignment[i] = best;
+        }
+        if (!changed)
+            break;
+        std::vector<std::vector<double>> sums(centres.size(), std::vector<double>(BBV_DIMENSIONS));
+        std::vector<std::uint64_t> counts(centres.size());
+        for (std::uint64_t i = 0; i < m_vectors.size(); i++) {
+            counts[assignment[i]]++;
+            for (std::uint64_t d = 0; d < BBV_DIMENSIONS; d++)
+                sums[assignment[i]][d] += m_vectors[i][d];
+        }
+        for (std::uint64_t c = 0; c < centres.size(); c++) {
+            for (std::uint64_t d = 0; counts[c] != 0 && d < BBV_DIMENSIONS; d++)
+                centres[c][d] = sums[c][d] / (double) counts[c];
+        }
+    }
+}
+
+//the Bayesian information criterion of a clustering, as SimPoint scores them: how likely the intervals are
+//if each cluster is a spherical gaussian around its centre, less a penalty for every parameter that takes
+double Sampler::bic(const std::vector<std::uint32_t>& assignment, const std::vector<std::vector<double>>& centres) const {
+    double r = (double) m_vectors.size(), k = (double) centres.size(), m = BBV_DIMENSIONS;
+    std::vector<double> sizes(centres.size());
+    double squares = 0;
+    for (std::uint64_t i = 0; i < m_vectors.size(); i++) {
+        sizes[assignment[i]]++;
+        squares += distance(m_vectors[i], centres[assignment[i]]);
+    }
+    //(near) identical intervals would make it (close to) infinite, at the floor every k scores the same apart
+    //from the penalty
+    double variance = std::max(r > k ? squares / (m * (r - k)) : 0.0, BIC_MIN_VARIANCE);
+
+    double likelihood = 0;
+    for (double size : sizes) {
+        if (size != 0)
+            likelihood += size * std::log(size / r) - size * m / 2 * std::log(2 * M_PI * variance) - m * (size - 1) / 2;
+    }
+    double parameters = (k - 1) + k * m + 1; //the cluster sizes, the centres and the variance
+    return likelihood - parameters / 2 * std::log(r);
+}
+
+//clusters the interval vectors for k from 1 up to m_clusters and keeps the smallest k that scores close to
+//the best, so a program with few phases isn't split up just because more clusters are allowed. returns the
+//interval nearest the middle of each cluster and how many intervals each one stands for
+std::vector<std::uint32_t> Sampler::cluster(std::vector<std::uint32_t>& sizes) {
+    std::uint64_t most = std::min<std::uint64_t>(m_clusters, m_vectors.size());
+    std::vector<std::vector<std::uint32_t>> assignments(most);
+    std::vector<std::vector<std::vector<double>>> clusterings(most);
+    std::vector<double> scores(most);
+    for (std::uint64_t k = 1; k <= most; k++) {
+        kmeans(k, assignments[k - 1], clusterings[k - 1]);
+        scores[k - 1] = bic(assignments[k - 1], clusterings[k - 1]);
+    }
+    double best = *std::max_element(scores.begin(), scores.end());
+    double worst = *std::min_element(scores.begin(), scores.end());
+    std::uint64_t chosen = 0;
+    while (scores[chosen] < worst + BIC_THRESHOLD * (best - worst))
+        chosen++;
+    const std::vector<std::uint32_t>& assignment = assignments[chosen];
+    const std::vector<std::vector<double>>& centres = clusterings[chosen];
+
+    std::vector<std::uint32_t> picks;
+    for (std::uint32_t c = 0; c < centres.size(); c++) {
+        std::uint32_t size = 0, pick = 0;
+        for (std::uint32_t i = 0; i < m_vectors.size(); i++) {
+            if (assignment[i] != c)
+                continue;
+            if (size++ == 0 || distance(m_vectors[i], centres[c]) < distance(m_vectors[pick], centres[c]))
+                pick = i;
+        }
+        if (size != 0) {
+            picks.push_back(pick);
+            sizes.push_back(size);
+        }
+    }
+    return picks;
+}
+
+//runs from a checkpoint taken at instruction start through the timing model, measuring only the interval itself
+Sample Sampler::simulate(const std::function<CPU*()>& make, const Checkpoint& checkpoint, std::uint64_t start,
+                         std::uint64_t interval) {
+    CPU* cpu = make();
+    cpu->restore(checkpoint);
+    cpu->sandbox();
+
+    CacheTiming timing;
+    cpu->run(interval * m_interval - start, timing); //warming up
+    Sample sample{interval, 0, timing.instructions, timing.cycles, timing.l1d.misses, timing.l2.misses, timing.mispredicts};
+    cpu->run(m_interval, timing);
+    delete cpu;
+
+    sample.instructions = timing.instructions - sample.instructions;
+    sample.cycles = timing.cycles - sample.cycles;
+    sample.l1d_misses = timing.l1d.misses - sample.l1d_misses;
+    sample.l2_misses = timing.l2.misses - sample.l2_misses;
+    sample.mispredicts = timing.mispredicts - sample.mispredicts;
+    return sample;
+}
+
+SampleReport Sampler::run(CPU& cpu, const std::function<CPU*()>& make) {
+    SampleReport report{{StopReason::BudgetExhausted, 0, 0, 0}, 0, 0, {}, 0, 0, 0};
+    m_vectors.clear();
+
+    //the real run, profiled an interval at a time
+    auto start = std::chrono::steady_clock::now();
+    BbvProfile profile;
+    while (report.stop.reason == StopReason::BudgetExhausted) {
+        RunResult result = cpu.run(m_interval, profile);
+        profile.end_block();
+        if (result.instructions != 0)
+            project(profile, result.instructions);
+        profile.counts.clear();
+        report.instructions += result.instructions;
+        report.stop = result;
+    }
+    report.intervals = m_vectors.size();
+    report.profile_ms = milliseconds_since(start);
+    if (m_vectors.empty())
+        return report;
+
+    std::vector<std::uint32_t> sizes;
+    std::vector<std::uint32_t> picks = cluster(sizes);
+
+    //run it again to each sample's warm up point, in order
+    start = std::chrono::steady_clock::now();
+    std::map<std::uint32_t, double> weights; //by interval
+    for (std::uint64_t i = 0; i < picks.size(); i++)
+        weights[picks[i]] = (double) sizes[i] / (double) m_vectors.size();
+    std::vector<std::pair<std::uint32_t, Checkpoint>> checkpoints;
+    std::vector<std::uint64_t> starts;
+    CPU* rerun = make();
+    rerun->sandbox();
+    std::uint64_t position = 0;
+    std::uint64_t warmup = std::min<std::uint64_t>(SAMPLE_WARMUP, m_interval); //so the warm ups don't overlap
+    for (auto& [interval, weight] : weights) {
+        std::uint64_t target = interval * m_interval - std::min<std::uint64_t>(interval * m_interval, warmup);
+        //a run that went differently may stop early, the samples past that point are lost
+        while (position < target && !rerun->halted()) {
+            RunResult result = rerun->run(target - position);
+            position += result.instructions;
+            if (result.reason != StopReason::BudgetExhausted)
+                break;
+        }
+        if (position != target)
+            break;
+        checkpoints.emplace_back(interval, rerun->checkpoint());
+        starts.push_back(position);
+    }
+    delete rerun;
+    report.checkpoint_ms = milliseconds_since(start);
+
+    //and simulate them all at once
+    start = std::chrono::steady_clock::now();
+    report.samples.resize(checkpoints.size());
+    std::atomic<std::uint64_t> next{};
+    std::vector<std::thread> workers;
+    for (std::uint32_t t = 0; t < std::min<std::uint64_t>(m_threads, checkpoints.size()); t++) {
+        workers.emplace_back([&]() {
+            std::uint64_t i;
+            while ((i = next.fetch_add(1)) < checkpoints.size()) {
+                report.samples[i] = simulate(make, checkpoints[i].second, starts[i], checkpoints[i].first);
+                report.samples[i].weight = weights.at(checkpoints[i].first);
+            }
+        });
+    }
+    for (auto& worker : workers)
+        worker.join();
+    report.detail_ms = milliseconds_since(start);
+    return report;
+}
+
+double SampleReport::cpi() const {
+    double cpi = 0, weight = 0;
+    for (auto& sample : samples) {
+        if (sample.instructions == 0)
+            continue;
+        cpi += sample.weight * (double) sample.cycles / (double) sample.instructions;
+        weight += sample.weight;
+    }
+    return weight != 0 ? cpi / weight : 0.0; //samples that were lost don't count
+}
+
+void SampleReport::dump_stats() const {
+    std::fprintf(stderr, "instructions:%lu intervals:%lu samples:%lu\n", instructions, intervals, samples.size());
+    std::fprintf(stderr, "%10s %8s %14s %14s %6s %12s %12s %12s\n", "interval", "weight", "instructions", "cycles", "CPI",
+                 "L1D misses", "L2 misses", "mispredicts");
+    for (auto& sample : samples) {
+        std::fprintf(stderr, "%10lu %8.4f %14lu %14lu %6.2f %12lu %12lu %12lu\n", sample.interval, sample.weight,
+                     sample.instructions, sample.cycles,
+                     sample.instructions != 0 ? (double) sample.cycles / (double) sample.instructions : 0.0,
+                     sample.l1d_misses, sample.l2_misses, sample.mispredicts);
+    }
+    std::fprintf(stderr, "estimated CPI:%.3f cycles:%.0f\n", cpi(), cpi() * (double) instructions);
+    std::fprintf(stderr, "profile:%lums checkpoints:%lums detailed:%lums\n", profile_ms, checkpoint_ms, detail_ms);
+}
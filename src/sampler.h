@@ -0,0 +1,77 @@
+//
+// Created by John on 19/10/2026.
+//
+
+#ifndef CPPRV64_SAMPLER_H
+#define CPPRV64_SAMPLER_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "cpu.h"
+
+#define SAMPLE_INTERVAL 10000000 //default instructions per interval
+#define SAMPLE_CLUSTERS 10 //at most this many intervals are simulated in detail
+#define SAMPLE_WARMUP 1000000 //instructions run through the timing model before a sample, to warm its caches
+#define BBV_DIMENSIONS 15 //basic block vectors are randomly projected down to this many dimensions, as in SimPoint
+#define KMEANS_ITERATIONS 100
+#define BIC_THRESHOLD 0.9 //the smallest k scoring this far from the worst score to the best is used, as in SimPoint
+#define BIC_MIN_VARIANCE 1e-6 //spread between intervals below this is noise (where the interval boundaries fell), not phases
+
+//one interval simulated in detail, standing in for the intervals it was clustered with
+struct Sample {
+    std::uint64_t interval; //counting from 0
+    double weight; //fraction of all the intervals its cluster holds
+    std::uint64_t instructions; //measured, short of a whole interval if the re-run went differently
+    std::uint64_t cycles;
+    std::uint64_t l1d_misses;
+    std::uint64_t l2_misses;
+    std::uint64_t mispredicts;
+};
+
+struct SampleReport {
+    RunResult stop; //how the real run ended
+    std::uint64_t instructions; //in the whole run
+    std::uint64_t intervals;
+    std::vector<Sample> samples;
+    std::uint64_t profile_ms; //running it for real and collecting basic block vectors
+    std::uint64_t checkpoint_ms; //running it again to save a checkpoint before each sample
+    std::uint64_t detail_ms; //simulating the samples in detail
+
+    //the weighted average of the samples
+    double cpi() const;
+    void dump_stats() const;
+};
+
+// SimPoint style sampled simulation, to estimate the timing of a whole run (see CacheTiming) at close
+// to functional speed. The run is cut into intervals of so many instructions and each interval's
+// basic block vector is collected as it goes. The vectors are clustered with k-means, with k chosen
+// by BIC score (at most SAMPLE_CLUSTERS), and the interval nearest the middle of each cluster is
+// picked to represent it. The program is then run
+// again (sandboxed) to checkpoint just before each pick, and the picks are simulated in detail from
+// their checkpoints in parallel, one host thread each.
+// The second run has to go the same way as the first, so programs that read stdin or otherwise
+// depend on the outside world get less accurate picks.
+class Sampler {
+private:
+    std::uint64_t m_interval;
+    std::uint32_t m_clusters;
+    std::uint32_t m_threads;
+    std::vector<std::vector<double>> m_vectors; //one per interval, projected
+
+    void project(const BbvProfile&, std::uint64_t instructions);
+    void kmeans(std::uint64_t k, std::vector<std::uint32_t>& assignment, std::vector<std::vector<double>>& centres) const;
+    double bic(const std::vector<std::uint32_t>& assignment, const std::vector<std::vector<double>>& centres) const;
+    std::vector<std::uint32_t> cluster(std::vector<std::uint32_t>& sizes);
+    Sample simulate(const std::function<CPU*()>& make, const Checkpoint&, std::uint64_t start, std::uint64_t interval);
+public:
+    explicit Sampler(std::uint64_t interval = SAMPLE_INTERVAL, std::uint32_t clusters = SAMPLE_CLUSTERS,
+                     std::uint32_t threads = 0); //0 for one per host core
+
+    //runs cpu to the end, then simulates the samples in CPUs from make, which should each
+    //come out set up just like cpu was before it started
+    SampleReport run(CPU& cpu, const std::function<CPU*()>& make);
+};
+
+#endif //CPPRV64_SAMPLER_H
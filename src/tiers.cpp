@@ -0,0 +1,117 @@
+//
+// Created by John on 19/10/2026.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iterator>
+
+#include "tiers.h"
+
+bool TierManager::ends_block(std::uint32_t instruction) {
+    switch (instruction & 0x7f) {
+        case 0x0f: //fence, fence.i
+        case 0x63: //branches
+        case 0x67: //jalr
+        case 0x6f: //jal
+        case 0x73: //ecall, xret, csr access (can change mode)
+            return true;
+        default:
+            return false;
+    }
+}
+
+Block* TierManager::promote(std::uint64_t pc, Bus& bus) {
+    auto start = std::chrono::steady_clock::now();
+
+    Block block{pc, {}};
+    for (std::uint64_t addr = pc; block.instructions.size() < MAX_BLOCK_LENGTH; addr += 4) {
+        auto word = bus.readable_pointer(addr, 4);
+        if (word == nullptr) //ran off the end of memory, leave it to the interpreter to fault
+            break;
+        std::uint32_t instruction;
+        std::memcpy(&instruction, word, 4);
+        block.instructions.push_back(decode(instruction));
+        if (ends_block(instruction))
+            break;
+    }
+    m_counts.erase(pc);
+    if (block.instructions.empty())
+        return nullptr;
+    Block* promoted = &(m_blocks[pc] = std::move(block));
+
+    auto ns = (std::uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    stats.promotions++;
+    stats.promotion_ns += ns;
+    stats.max_promotion_ns = std::max(stats.max_promotion_ns, ns);
+    return promoted;
+}
+
+bool TierManager::predict(Block** slot, std::uint64_t target) {
+    if (*slot != nullptr){
+        m_predicted = *slot;
+        return true;
+    }
+    m_fill = slot;
+    m_fill_pc = target;
+    return false;
+}
+
+void TierManager::jumped(const Decoded& jump, std::uint64_t pc, std::uint64_t target, Block* block) {
+    std::uint64_t link = pc + 4;
+    if (jump.op == Op::jalr && jump.rd == 0 && jump.rs1 == 1){
+        ReturnAddress& top = m_return_stack[--m_return_top % RETURN_STACK_DEPTH];
+        stats.returns++;
+        if (top.pc == target && top.block != nullptr && predict(top.block, target))
+            stats.return_hits++;
+        return;
+    }
+    if (jump.op == Op::jalr){
+        Target& entry = m_targets[(pc >> 2) % TARGET_CACHE_SIZE];
+        if (entry.pc != pc || entry.target != target)
+            entry = {pc, target, nullptr};
+        stats.indirect_jumps++;
+        if (predict(&entry.block, target))
+            stats.indirect_hits++;
+    } else if (jump.op != Op::jal){
+        return;
+    }
+    //a call the accelerator did on the host has already returned
+    if (jump.rd == 1 && target != link)
+        m_return_stack[m_return_top++ % RETURN_STACK_DEPTH] =
+                {link, block != nullptr ? &block->return_block : nullptr};
+}
+
+void TierManager::flush() {
+    m_blocks.clear();
+    m_counts.clear();
+    m_flush_pending = false;
+    //everything below points into the blocks
+    std::fill(std::begin(m_return_stack), std::end(m_return_stack), ReturnAddress{});
+    std::fill(std::begin(m_targets), std::end(m_targets), Target{});
+    m_predicted = nullptr;
+    m_fill = nullptr;
+    stats.flushes++;
+}
+
+void TierManager::dump_stats() {
+    std::uint64_t instructions = stats.interpreted_instructions + stats.cached_instructions;
+    std::fprintf(stderr, "interpreted blocks:%12lu instructions:%14lu\n",
+                 stats.interpreted_blocks, stats.interpreted_instructions);
+    std::fprintf(stderr, "cached blocks:     %12lu instructions:%14lu (%.1f%%)\n",
+                 stats.cached_blocks, stats.cached_instructions,
+                 instructions != 0 ? 100.0 * (double) stats.cached_instructions / (double) instructions : 0.0);
+    std::fprintf(stderr, "promotions:%lu (%lu cached now) latency avg:%luns max:%luns flushes:%lu\n",
+                 stats.promotions, m_blocks.size(),
+                 stats.promotions != 0 ? stats.promotion_ns / stats.promotions : 0,
+                 stats.max_promotion_ns, stats.flushes);
+    std::uint64_t blocks = stats.interpreted_blocks + stats.cached_blocks;
+    std::fprintf(stderr, "returns:%lu (%.1f%% predicted) indirect jumps:%lu (%.1f%% predicted) "
+                         "lookups skipped:%lu (%.1f%% of blocks)\n",
+                 stats.returns, stats.returns != 0 ? 100.0 * (double) stats.return_hits / (double) stats.returns : 0.0,
+                 stats.indirect_jumps,
+                 stats.indirect_jumps != 0 ? 100.0 * (double) stats.indirect_hits / (double) stats.indirect_jumps : 0.0,
+                 stats.predicted_blocks, blocks != 0 ? 100.0 * (double) stats.predicted_blocks / (double) blocks : 0.0);
+}
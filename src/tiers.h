@@ -0,0 +1,125 @@
+//
+// Created by John on 19/10/2026.
+//
+
+#ifndef CPPRV64_TIERS_H
+#define CPPRV64_TIERS_H
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "bus.h"
+#include "decoder.h"
+
+#define PROMOTION_THRESHOLD 16 //times a block is interpreted before it's promoted to the block cache
+#define MAX_BLOCK_LENGTH 64 //instructions
+#define RETURN_STACK_DEPTH 16 //calls the return address stack remembers, a power of two
+#define TARGET_CACHE_SIZE 256 //entries in the indirect jump target cache, a power of two
+
+//a straight line run of instructions ending in a jump, branch or system instruction,
+//already fetched out of memory and decoded so running it skips the bus and the decoder entirely
+struct Block {
+    std::uint64_t pc;
+    std::vector<Decoded> instructions;
+    Block* return_block{}; //where the call that ends this block comes back to, once that's been cached
+};
+
+struct TierStats {
+    std::uint64_t interpreted_blocks;
+    std::uint64_t interpreted_instructions;
+    std::uint64_t cached_blocks;
+    std::uint64_t cached_instructions;
+    std::uint64_t promotions;
+    std::uint64_t promotion_ns; //total time spent building blocks
+    std::uint64_t max_promotion_ns;
+    std::uint64_t flushes;
+    std::uint64_t predicted_blocks; //found through a predicted jump instead of a lookup
+    std::uint64_t returns;
+    std::uint64_t return_hits;
+    std::uint64_t indirect_jumps; //jalr other than returns
+    std::uint64_t indirect_hits;
+};
+
+// Decides how each block of guest code runs. Cold code is interpreted an instruction at a time
+// while its entry point is counted, once a block has run PROMOTION_THRESHOLD times it is built
+// and cached so later runs of it are straight from the cache. Code that only runs a few times
+// (startup, init) never pays for being cached.
+// Returns and indirect calls would need a lookup every time since their target is only known at
+// runtime, so they're predicted with a return address stack and a target cache indexed by the
+// jump's PC. A right guess leaves the next block one compare away.
+class TierManager {
+private:
+    struct ReturnAddress {
+        std::uint64_t pc;
+        Block** block; //the calling block's return_block, nullptr if the call was interpreted
+    };
+    struct Target {
+        std::uint64_t pc; //of the jalr
+        std::uint64_t target;
+        Block* block;
+    };
+
+    std::unordered_map<std::uint64_t, std::uint32_t> m_counts;
+    std::unordered_map<std::uint64_t, Block> m_blocks;
+    std::uint32_t m_threshold;
+    bool m_flush_pending{};
+
+    ReturnAddress m_return_stack[RETURN_STACK_DEPTH]{};
+    std::uint32_t m_return_top{}; //wraps around, calls deeper than the stack overwrite the oldest
+    Target m_targets[TARGET_CACHE_SIZE]{};
+    Block* m_predicted{}; //where the last jump is expected to have gone
+    Block** m_fill{}; //a prediction with no block yet, filled in by the next lookup if it's for m_fill_pc
+    std::uint64_t m_fill_pc{};
+
+    bool predict(Block** slot, std::uint64_t target);
+public:
+    TierStats stats{};
+
+    explicit TierManager(std::uint32_t threshold = PROMOTION_THRESHOLD) : m_threshold(threshold) {}
+
+    Block* lookup(std::uint64_t pc) {
+        auto it = m_blocks.find(pc);
+        return it != m_blocks.end() ? &it->second : nullptr;
+    }
+
+    //the block to run at pc, nullptr if it hasn't been promoted. free after a correctly predicted jump
+    Block* next(std::uint64_t pc) {
+        Block* predicted = m_predicted;
+        m_predicted = nullptr;
+        if (predicted != nullptr && predicted->pc == pc){
+            stats.predicted_blocks++;
+            return predicted;
+        }
+        Block* block = lookup(pc);
+        if (m_fill != nullptr && m_fill_pc == pc)
+            *m_fill = block;
+        m_fill = nullptr;
+        return block;
+    }
+
+    //a block ending in jump (at pc) just went to target, block is the cached block it ended if there was one.
+    //keeps the return address stack and target cache up to date and predicts the next block
+    void jumped(const Decoded& jump, std::uint64_t pc, std::uint64_t target, Block* block);
+
+    //counts an interpreted run of the block at pc, true once it's hot enough to promote
+    bool count(std::uint64_t pc) {
+        return ++m_counts[pc] >= m_threshold;
+    }
+
+    Block* promote(std::uint64_t pc, Bus&);
+
+    //cached code is stale (fence.i, remapped memory), dropped once the current block finishes
+    void invalidate() { m_flush_pending = true; }
+    void flush_if_invalidated() {
+        if (m_flush_pending)
+            flush();
+    }
+    void flush();
+
+    static bool ends_block(std::uint32_t instruction);
+
+    void dump_stats();
+};
+
+#endif //CPPRV64_TIERS_H
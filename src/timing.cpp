@@ -0,0 +1,84 @@
+//
+// Created by John on 19/10/2026.
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "timing.h"
+
+Cache::Cache(std::uint64_t size, std::uint64_t ways) : m_sets(size / (ways * CACHE_LINE_SIZE)), m_ways(ways),
+                                                       m_tags(m_sets * ways), m_last_used(m_sets * ways) {}
+
+bool Cache::access(std::uint64_t addr) {
+    std::uint64_t line = addr / CACHE_LINE_SIZE;
+    std::uint64_t first = (line % m_sets) * m_ways;
+    std::uint64_t victim = first;
+    m_clock++;
+    for (std::uint64_t way = first; way < first + m_ways; way++) {
+        if (m_tags[way] == line + 1) {
+            m_last_used[way] = m_clock;
+            hits++;
+            return true;
+        }
+        if (m_last_used[way] < m_last_used[victim])
+            victim = way;
+    }
+    m_tags[victim] = line + 1;
+    m_last_used[victim] = m_clock;
+    misses++;
+    return false;
+}
+
+CacheTiming::CacheTiming() {
+    std::memset(m_counters, 1, sizeof(m_counters)); //weakly not taken
+}
+
+void CacheTiming::call(std::uint64_t target) {
+    //calls too deep to track (or that never return, like longjmp) are charged to the deepest function
+    if (m_call_stack.size() < MAX_CALL_DEPTH) {
+        m_call_stack.push_back(m_current);
+        m_current = &m_functions[target];
+        m_current->calls++;
+    } else {
+        m_untracked_calls++;
+    }
+}
+
+void CacheTiming::ret() {
+    if (m_untracked_calls != 0) {
+        m_untracked_calls--;
+    } else if (m_call_stack.size() > 1) { //the bottom entry is whatever was running when timing started
+        m_current = m_call_stack.back();
+        m_call_stack.pop_back();
+    }
+}
+
+static double rate(std::uint64_t hits, std::uint64_t misses) {
+    return hits + misses != 0 ? 100.0 * (double) hits / (double) (hits + misses) : 0.0;
+}
+
+void CacheTiming::dump_stats(const std::vector<Symbol>& symbols) {
+    std::fprintf(stderr, "instructions:%lu cycles:%lu CPI:%.2f\n", instructions, cycles,
+                 instructions != 0 ? (double) cycles / (double) instructions : 0.0);
+    std::fprintf(stderr, "L1I hits:%lu misses:%lu (%.2f%%)\n", l1i.hits, l1i.misses, rate(l1i.hits, l1i.misses));
+    std::fprintf(stderr, "L1D hits:%lu misses:%lu (%.2f%%)\n", l1d.hits, l1d.misses, rate(l1d.hits, l1d.misses));
+    std::fprintf(stderr, "L2  hits:%lu misses:%lu (%.2f%%)\n", l2.hits, l2.misses, rate(l2.hits, l2.misses));
+    std::fprintf(stderr, "branches:%lu mispredicted:%lu (%.2f%% predicted)\n", branches, mispredicts,
+                 rate(branches - mispredicts, mispredicts));
+
+    std::unordered_map<std::uint64_t, const char*> names;
+    for (auto& symbol : symbols)
+        names[symbol.addr] = symbol.name.c_str();
+    std::vector<std::pair<std::uint64_t, FunctionCost>> functions(m_functions.begin(), m_functions.end());
+    std::sort(functions.begin(), functions.end(), [](auto& a, auto& b) { return a.second.cycles > b.second.cycles; });
+    std::fprintf(stderr, "%-32s %10s %14s %14s\n", "function", "calls", "instructions", "cycles");
+    for (std::uint64_t i = 0; i < functions.size() && i < 20; i++) {
+        auto& [entry, cost] = functions[i];
+        char address[32];
+        std::snprintf(address, sizeof(address), "0x%lX", entry);
+        std::fprintf(stderr, "%-32s %10lu %14lu %14lu\n", names.count(entry) ? names[entry] : address,
+                     cost.calls, cost.instructions, cost.cycles);
+    }
+}
@@ -0,0 +1,159 @@
+//
+// Created by John on 19/10/2026.
+//
+
+#ifndef CPPRV64_TIMING_H
+#define CPPRV64_TIMING_H
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "process.h"
+
+#define CACHE_LINE_SIZE 64
+#define L2_LATENCY 12 //extra cycles for an L1 miss that hits in L2
+#define MEMORY_LATENCY 100 //extra cycles for a miss in L2
+#define MISPREDICT_PENALTY 7
+#define PREDICTOR_ENTRIES 4096
+#define MAX_CALL_DEPTH 1024
+
+// The timing hooks the execution engine calls on every fetch, load, store and control transfer.
+// The engine is a template over its timing model, so with NoTiming every hook is an empty inline
+// function and the functional-only build compiles to exactly what it did without them.
+struct NoTiming {
+    void fetch(std::uint64_t) {}
+    void load(std::uint64_t, std::uint64_t) {}
+    void store(std::uint64_t, std::uint64_t) {}
+    void branch(std::uint64_t, bool) {}
+    void call(std::uint64_t) {}
+    void ret() {}
+};
+
+// Counts how many instructions run in each basic block, for sampled simulation (see sampler.h).
+// A block starts wherever the pc doesn't follow on from the last instruction, so only the fetch
+// hook does anything and the map is touched once per block rather than once per instruction.
+struct BbvProfile {
+    std::unordered_map<std::uint64_t, std::uint64_t> counts; //block start -> instructions run in it
+
+    void fetch(std::uint64_t pc) {
+        if (pc != m_next) {
+            end_block();
+            m_block = pc;
+        }
+        m_next = pc + 4;
+        m_length++;
+    }
+    void load(std::uint64_t, std::uint64_t) {}
+    void store(std::uint64_t, std::uint64_t) {}
+    void branch(std::uint64_t, bool) {}
+    void call(std::uint64_t) {}
+    void ret() {}
+
+    //counts what has run of the block in progress, so counts is complete. the block stays open, what runs
+    //of it next (in the next interval) is still counted against where it started
+    void end_block() {
+        if (m_length != 0)
+            counts[m_block] += m_length;
+        m_length = 0;
+    }
+private:
+    std::uint64_t m_block{};
+    std::uint64_t m_next{};
+    std::uint64_t m_length{};
+};
+
+//a set associative cache with LRU replacement, only tags are kept
+struct Cache {
+private:
+    std::uint64_t m_sets;
+    std::uint64_t m_ways;
+    std::vector<std::uint64_t> m_tags; //line address + 1, so that 0 is an empty way
+    std::vector<std::uint64_t> m_last_used;
+    std::uint64_t m_clock{};
+public:
+    std::uint64_t hits{};
+    std::uint64_t misses{};
+
+    Cache(std::uint64_t size, std::uint64_t ways);
+
+    //true on a hit, a miss fills the line
+    bool access(std::uint64_t addr);
+};
+
+// Estimates how guest code would run on a simple in-order core: split L1 instruction and data
+// caches over a shared L2, and a bimodal branch predictor. Every instruction costs a cycle plus
+// whatever its fetch and memory accesses miss by, plus a penalty for mispredicted branches.
+// Cycles are also attributed to the function they're spent in, tracked through calls and returns.
+struct CacheTiming {
+private:
+    struct FunctionCost {
+        std::uint64_t calls;
+        std::uint64_t instructions;
+        std::uint64_t cycles;
+    };
+
+    std::uint8_t m_counters[PREDICTOR_ENTRIES]; //2 bit saturating counters, >= 2 predicts taken
+    std::unordered_map<std::uint64_t, FunctionCost> m_functions; //by entry point
+    std::vector<FunctionCost*> m_call_stack;
+    FunctionCost* m_current{};
+    std::uint64_t m_untracked_calls{}; //made with the call stack full, their returns mustn't pop a frame
+
+    void access(Cache& l1, std::uint64_t addr) {
+        if (!l1.access(addr))
+            cycles += l2.access(addr) ? L2_LATENCY : L2_LATENCY + MEMORY_LATENCY;
+    }
+public:
+    Cache l1i{32 * 1024, 8};
+    Cache l1d{32 * 1024, 8};
+    Cache l2{1024 * 1024, 16};
+    std::uint64_t instructions{};
+    std::uint64_t cycles{};
+    std::uint64_t branches{};
+    std::uint64_t mispredicts{};
+
+    CacheTiming();
+
+    void fetch(std::uint64_t pc) {
+        if (m_current == nullptr)
+            call(pc); //whatever is running when timing starts counts as the first function
+        std::uint64_t before = cycles++;
+        instructions++;
+        access(l1i, pc);
+        m_current->instructions++;
+        m_current->cycles += cycles - before;
+    }
+
+    void load(std::uint64_t addr, std::uint64_t) {
+        std::uint64_t before = cycles;
+        access(l1d, addr);
+        m_current->cycles += cycles - before;
+    }
+
+    void store(std::uint64_t addr, std::uint64_t) {
+        std::uint64_t before = cycles;
+        access(l1d, addr); //write allocate
+        m_current->cycles += cycles - before;
+    }
+
+    void branch(std::uint64_t pc, bool taken) {
+        std::uint8_t& counter = m_counters[(pc >> 2) % PREDICTOR_ENTRIES];
+        branches++;
+        if ((counter >= 2) != taken) {
+            mispredicts++;
+            cycles += MISPREDICT_PENALTY;
+            m_current->cycles += MISPREDICT_PENALTY;
+        }
+        if (taken && counter < 3)
+            counter++;
+        else if (!taken && counter > 0)
+            counter--;
+    }
+
+    void call(std::uint64_t target);
+    void ret();
+
+    void dump_stats(const std::vector<Symbol>&);
+};
+
+#endif //CPPRV64_TIMING_H
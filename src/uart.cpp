@@ -0,0 +1,69 @@
+//
+// Created by John on 19/10/2026.
+//
+
+#include "uart.h"
+
+Uart::Uart(IoThread& io, Channel* channel, std::atomic<std::uint32_t>& interrupts)
+        : m_io(io), m_channel(channel), m_interrupts(interrupts) {}
+
+std::uint64_t Uart::load(std::uint64_t offset) {
+    std::uint8_t byte = 0;
+    switch (offset) {
+        case UART_RHR:
+            if (m_channel->rx.pop(byte)){
+                received++;
+                if (m_channel->stalled.load(std::memory_order_relaxed))
+                    m_io.notify(); //there's room for the I/O thread to read more now
+                if ((m_ier & UART_IER_RX) != 0 && m_channel->rx.empty())
+                    m_interrupts.fetch_or(UART_IRQ, std::memory_order_relaxed); //the line just dropped
+            }
+            return byte;
+        case UART_IER:
+            return m_ier;
+        case UART_IIR:
+            return interrupting() ? UART_IIR_RX : UART_IIR_NONE;
+        case UART_LCR:
+            return m_lcr;
+        case UART_MCR:
+            return m_mcr;
+        case UART_LSR:
+            return (m_channel->rx.empty() ? 0 : UART_LSR_DR)
+                   | (m_channel->tx.full() ? 0 : UART_LSR_THRE)
+                   | (m_channel->tx.empty() ? UART_LSR_TEMT : 0);
+        case UART_SCR:
+            return m_scr;
+        default:
+            return 0;
+    }
+}
+
+void Uart::store(std::uint64_t offset, std::uint64_t data) {
+    switch (offset) {
+        case UART_THR:
+            //a guest that doesn't wait for THRE loses what it writes while the ring is full, like on real hardware
+            if (m_channel->tx.push((std::uint8_t) data)){
+                sent++;
+                m_io.notify();
+            } else {
+                dropped++;
+            }
+            break;
+        case UART_IER:
+            m_ier = data;
+            //enabling it with data already waiting raises the line straight away, disabling it drops it
+            m_interrupts.fetch_or(UART_IRQ, std::memory_order_relaxed);
+            break;
+        case UART_LCR:
+            m_lcr = data;
+            break;
+        case UART_MCR:
+            m_mcr = data;
+            break;
+        case UART_SCR:
+            m_scr = data;
+            break;
+        default:
+            break;
+    }
+}
@@ -0,0 +1,61 @@
+//
+// Created by John on 19/10/2026.
+//
+
+#ifndef CPPRV64_UART_H
+#define CPPRV64_UART_H
+
+#include <atomic>
+#include <cstdint>
+
+#include "io.h"
+
+//where the console sits in the guest's physical address space, the same place as on QEMU's virt machine
+#define UART_BASE 0x10000000
+#define UART_SIZE 0x100
+#define UART_IRQ 0x1 //bit in the bus interrupt word
+
+//16550 register offsets
+#define UART_RHR 0 //receive holding register (read)
+#define UART_THR 0 //transmit holding register (write)
+#define UART_IER 1 //interrupt enable
+#define UART_IIR 2 //interrupt identification (read)
+#define UART_LCR 3 //line control
+#define UART_MCR 4 //modem control
+#define UART_LSR 5 //line status
+#define UART_SCR 7 //scratch
+
+#define UART_IER_RX 0x01 //interrupt when there's data to read
+#define UART_IIR_NONE 0xc1 //fifos enabled, no interrupt pending
+#define UART_IIR_RX 0xc4 //fifos enabled, data to read
+#define UART_LSR_DR 0x01 //data ready
+#define UART_LSR_THRE 0x20 //room to transmit
+#define UART_LSR_TEMT 0x40 //transmitter empty
+
+// The hart side of a 16550 style serial console. Reads and writes of its registers only touch the
+// channel's rings, the host side of the console is handled by the I/O thread.
+// Only the receive interrupt is modelled, output never has to wait long enough to need one.
+class Uart {
+private:
+    IoThread& m_io;
+    Channel* m_channel;
+    std::atomic<std::uint32_t>& m_interrupts;
+    std::uint8_t m_ier{};
+    std::uint8_t m_lcr{};
+    std::uint8_t m_mcr{};
+    std::uint8_t m_scr{};
+public:
+    std::uint64_t received{}; //bytes the guest read
+    std::uint64_t sent{}; //bytes the guest wrote
+    std::uint64_t dropped{}; //written with the transmit ring full
+
+    Uart(IoThread&, Channel*, std::atomic<std::uint32_t>& interrupts);
+
+    std::uint64_t load(std::uint64_t offset);
+    void store(std::uint64_t offset, std::uint64_t data);
+
+    //the level of the interrupt line
+    bool interrupting() const { return (m_ier & UART_IER_RX) != 0 && !m_channel->rx.empty(); }
+};
+
+#endif //CPPRV64_UART_H
@@ -0,0 +1,48 @@
+//
+// Created by John on 19/10/2026.
+//
+// Checks the generated dispatch table (decoder.h) against a plain search of RV64_INSTRUCTIONS, for
+// every dispatch key with the bits outside the key filled in at random, so shared slots, empty slots
+// and don't care bits all get covered.
+
+#include <cstdio>
+#include <random>
+
+#include "decoder.h"
+
+#define WORDS_PER_KEY 4096
+
+//what decode_op has to agree with: the first entry whose mask and match fit, or nothing
+static Op search(std::uint32_t word) {
+    for (std::uint16_t i = 0; i < ISA_SIZE; i++) {
+        if ((word & ISA[i].mask) == ISA[i].match)
+            return (Op) i;
+    }
+    return Op::illegal;
+}
+
+static const char* name(Op op) {
+    return op == Op::illegal ? "illegal" : ISA[(std::uint16_t) op].name;
+}
+
+int main() {
+    std::mt19937 random(64);
+    std::uint64_t failures = 0, decoded = 0;
+    for (std::uint32_t key = 0; key < 1024; key++) {
+        std::uint32_t fixed = ((key & 0x1f) << 2) | (((key >> 5) & 0x7) << 12)
+                              | (((key >> 8) & 0x1) << 25) | (((key >> 9) & 0x1) << 30);
+        for (int i = 0; i < WORDS_PER_KEY; i++) {
+            //the low two bits are always 11 for a 32 bit instruction, but decode has to cope with anything
+            std::uint32_t word = (random() & ~DISPATCH_BITS) | fixed;
+            //every entry's own encoding with its don't care bits randomised too, so each one gets hit
+            if (i < ISA_SIZE)
+                word = ISA[i].match | (word & ~ISA[i].mask);
+            Op expected = search(word), got = decode_op(word);
+            decoded++;
+            if (got != expected && failures++ < 20)
+                std::printf("FAIL: %08x decodes as %s, should be %s\n", word, name(got), name(expected));
+        }
+    }
+    std::printf("%lu words decoded, %lu wrong\n", decoded, failures);
+    return failures == 0 ? 0 : 1;
+}